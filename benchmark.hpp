@@ -2,18 +2,85 @@
 
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cctype>
 #include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
 #include <functional>
 #include <initializer_list>
+#include <iomanip>
 #include <iostream>
+#include <limits>
 #include <map>
+#include <mutex>
 #include <optional>
+#include <sstream>
+#include <string>
 #include <string_view>
+#include <thread>
+#include <type_traits>
 #include <vector>
 #include <memory>
 
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || \
+    defined(_M_IX86)
+#define BENCHMARK_HAS_TSC 1
+#ifndef _MSC_VER
+#include <x86intrin.h>
+#endif
+#else
+#define BENCHMARK_HAS_TSC 0
+#endif
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#if defined(__linux__) && __has_include(<linux/perf_event.h>)
+#define BENCHMARK_HAS_PERF_EVENT 1
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#else
+#define BENCHMARK_HAS_PERF_EVENT 0
+#endif
+
+// iterations in one sample, 0 means calibrate automatically to reach
+// BENCHMARK_SAMPLE_TIME_MS
 #ifndef BENCHMARK_REPEAT_NUM
-#define BENCHMARK_REPEAT_NUM 1000
+#define BENCHMARK_REPEAT_NUM 0
+#endif
+
+// max samples collected for one unit
+#ifndef BENCHMARK_SAMPLE_NUM
+#define BENCHMARK_SAMPLE_NUM 50
+#endif
+
+// target time of one sample when calibrating
+#ifndef BENCHMARK_SAMPLE_TIME_MS
+#define BENCHMARK_SAMPLE_TIME_MS 10
+#endif
+
+// run the unit at least this time before collecting samples
+#ifndef BENCHMARK_WARMUP_MS
+#define BENCHMARK_WARMUP_MS 100
+#endif
+
+// stop collecting samples when the unit ran longer than this(at least one
+// sample is collected)
+#ifndef BENCHMARK_MAX_TIME_MS
+#define BENCHMARK_MAX_TIME_MS 5000
 #endif
 
 namespace benchmark {
@@ -22,37 +89,1219 @@ class Measure;
 
 using BenchmarkFunc = std::function<void(void)>;
 using BenchmarkFuncWithOp = std::function<void(Measure)>;
+using FixtureFunc = std::function<void(const Measure&)>;
+
+//! @brief force the value to be computed and kept, so the compiler can't
+//! delete the code that produces it
+//! @note `value` is also treated as read and modified by unknown code, pass
+//! inputs to it to prevent constant folding
+#if defined(__GNUC__) || defined(__clang__)
+template <typename T>
+inline void DoNotOptimize(const T& value) {
+    if constexpr (std::is_trivially_copyable_v<T> &&
+                  sizeof(T) <= sizeof(void*)) {
+        asm volatile("" : : "r,m"(value) : "memory");
+    } else {
+        asm volatile("" : : "m"(value) : "memory");
+    }
+}
+
+template <typename T>
+inline void DoNotOptimize(T& value) {
+    if constexpr (std::is_trivially_copyable_v<T> &&
+                  sizeof(T) <= sizeof(void*)) {
+#ifdef __clang__
+        asm volatile("" : "+r,m"(value) : : "memory");
+#else
+        asm volatile("" : "+m,r"(value) : : "memory");
+#endif
+    } else {
+        asm volatile("" : "+m"(value) : : "memory");
+    }
+}
+
+//! @brief force all pending writes to be visible in memory
+inline void ClobberMemory() { asm volatile("" : : : "memory"); }
+#elif defined(_MSC_VER)
+namespace internal {
+inline void UseCharPointer(const volatile char*) {}
+}  // namespace internal
+
+template <typename T>
+inline void DoNotOptimize(const T& value) {
+    internal::UseCharPointer(&reinterpret_cast<const volatile char&>(value));
+    _ReadWriteBarrier();
+}
+
+inline void ClobberMemory() { _ReadWriteBarrier(); }
+#else
+template <typename T>
+inline void DoNotOptimize(const T& value) {
+    static const void* volatile sink;
+    sink = &value;
+}
+
+inline void ClobberMemory() { std::atomic_signal_fence(std::memory_order_seq_cst); }
+#endif
+
+using Clock = std::chrono::steady_clock;
+
+inline uint64_t ElapsedNs(Clock::time_point begin) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() -
+                                                                begin)
+        .count();
+}
+
+//! @brief format nanoseconds with a readable unit
+inline std::string FormatTime(double ns) {
+    constexpr const char* units[] = {"ns", "us", "ms", "s"};
+    int unit = 0;
+    while (ns >= 1000 && unit < 3) {
+        ns /= 1000;
+        unit++;
+    }
+    std::ostringstream stream;
+    stream << std::fixed << std::setprecision(3) << ns << units[unit];
+    return stream.str();
+}
+
+//! @brief format operations per second with a readable unit
+inline std::string FormatRate(double perSecond) {
+    constexpr const char* units[] = {"", "k", "M", "G"};
+    int unit = 0;
+    while (perSecond >= 1000 && unit < 3) {
+        perSecond /= 1000;
+        unit++;
+    }
+    std::ostringstream stream;
+    stream << std::fixed << std::setprecision(3) << perSecond << units[unit];
+    return stream.str();
+}
+
+//! @brief format bytes per second, eg: 1.5GB/s
+inline std::string FormatBytesRate(double perSecond) {
+    constexpr const char* units[] = {"B/s", "KB/s", "MB/s", "GB/s", "TB/s"};
+    int unit = 0;
+    while (perSecond >= 1000 && unit < 4) {
+        perSecond /= 1000;
+        unit++;
+    }
+    std::ostringstream stream;
+    stream << std::fixed << std::setprecision(3) << perSecond << units[unit];
+    return stream.str();
+}
+
+//! @brief statistics of samples, each sample is the average time of one
+//! iteration in nanoseconds
+struct Statistics final {
+    uint64_t iterations = 0;  //!< iterations in one sample
+    std::vector<double> samples;
+    double min = 0;
+    double max = 0;
+    double mean = 0;
+    double median = 0;
+    double stddev = 0;
+    double p90 = 0;
+    double p99 = 0;
+
+    static Statistics Compute(std::vector<double> samples,
+                              uint64_t iterations) {
+        Statistics stats;
+        stats.iterations = iterations;
+        stats.samples = std::move(samples);
+        if (stats.samples.empty()) {
+            return stats;
+        }
+
+        std::vector<double> sorted = stats.samples;
+        std::sort(sorted.begin(), sorted.end());
+        stats.min = sorted.front();
+        stats.max = sorted.back();
+        double sum = 0;
+        for (auto sample : sorted) {
+            sum += sample;
+        }
+        stats.mean = sum / sorted.size();
+        double variance = 0;
+        for (auto sample : sorted) {
+            variance += (sample - stats.mean) * (sample - stats.mean);
+        }
+        stats.stddev = sorted.size() > 1
+                           ? std::sqrt(variance / (sorted.size() - 1))
+                           : 0;
+        stats.median = Percentile(sorted, 0.5);
+        stats.p90 = Percentile(sorted, 0.9);
+        stats.p99 = Percentile(sorted, 0.99);
+        return stats;
+    }
+
+    //! @brief linear interpolated percentile of sorted samples
+    static double Percentile(const std::vector<double>& sorted, double p) {
+        double pos = p * (sorted.size() - 1);
+        size_t lower = static_cast<size_t>(pos);
+        size_t upper = std::min(lower + 1, sorted.size() - 1);
+        return sorted[lower] + (sorted[upper] - sorted[lower]) * (pos - lower);
+    }
+};
+
+//! @brief regularized incomplete beta function I_x(a, b)
+inline double IncompleteBeta(double a, double b, double x) {
+    if (x <= 0) return 0;
+    if (x >= 1) return 1;
+
+    // continued fraction by modified Lentz's method, converges quickly when
+    // x < (a + 1) / (a + b + 2), otherwise use I_x(a, b) = 1 - I_1-x(b, a)
+    auto continuedFraction = [](double a, double b, double x) {
+        constexpr double eps = 1e-12, tiny = 1e-300;
+        double c = 1, d = 1 - (a + b) * x / (a + 1);
+        d = 1 / (std::abs(d) < tiny ? tiny : d);
+        double h = d;
+        for (int m = 1; m <= 300; m++) {
+            for (int step = 0; step < 2; step++) {
+                double numerator =
+                    step == 0 ? m * (b - m) * x / ((a + 2 * m - 1) * (a + 2 * m))
+                              : -(a + m) * (a + b + m) * x /
+                                    ((a + 2 * m) * (a + 2 * m + 1));
+                d = 1 + numerator * d;
+                d = 1 / (std::abs(d) < tiny ? tiny : d);
+                c = 1 + numerator / c;
+                c = std::abs(c) < tiny ? tiny : c;
+                h *= c * d;
+            }
+            if (std::abs(c * d - 1) < eps) break;
+        }
+        return h;
+    };
+
+    double front = std::exp(std::lgamma(a + b) - std::lgamma(a) -
+                            std::lgamma(b) + a * std::log(x) +
+                            b * std::log(1 - x));
+    if (x < (a + 1) / (a + b + 2)) {
+        return front * continuedFraction(a, b, x) / a;
+    }
+    return 1 - front * continuedFraction(b, a, 1 - x) / b;
+}
+
+//! @brief two-sided p-value of Welch's t-test from summary statistics
+inline double WelchTTest(double mean1, double stddev1, uint64_t n1,
+                         double mean2, double stddev2, uint64_t n2) {
+    if (n1 < 2 || n2 < 2) return 1;
+    double v1 = stddev1 * stddev1 / n1;
+    double v2 = stddev2 * stddev2 / n2;
+    if (v1 + v2 == 0) return mean1 == mean2 ? 1 : 0;
+    double t = (mean1 - mean2) / std::sqrt(v1 + v2);
+    double df = (v1 + v2) * (v1 + v2) /
+                (v1 * v1 / (n1 - 1) + v2 * v2 / (n2 - 1));
+    return IncompleteBeta(df / 2, 0.5, df / (df + t * t));
+}
+
+//! @brief critical value of Student's t distribution, two-sided tail
+//! probability is alpha(eg: 0.05 for 95% confidence interval)
+inline double StudentTCritical(double alpha, double df) {
+    double lo = 0, hi = 1000;
+    for (int i = 0; i < 100; i++) {
+        double t = (lo + hi) / 2;
+        if (IncompleteBeta(df / 2, 0.5, df / (df + t * t)) > alpha) {
+            lo = t;
+        } else {
+            hi = t;
+        }
+    }
+    return (lo + hi) / 2;
+}
+
+//! @brief cheap clock for timing each call, reads the cpu time stamp counter
+//! on x86 and falls back to `Clock` elsewhere
+class TscClock final {
+ public:
+    //! @brief current ticks, only differences are meaningful
+    static uint64_t Now() {
+#if BENCHMARK_HAS_TSC
+        // fences keep the measured code from moving across the read
+        _mm_lfence();
+        uint64_t ticks = __rdtsc();
+        _mm_lfence();
+        return ticks;
+#else
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   Clock::now().time_since_epoch())
+            .count();
+#endif
+    }
+
+    //! @brief nanoseconds of one tick, calibrated against `Clock` once
+    static double NsPerTick() {
+        static double nsPerTick = []() {
+#if BENCHMARK_HAS_TSC
+            auto begin = Clock::now();
+            uint64_t ticksBegin = Now();
+            while (ElapsedNs(begin) < 20000000) {
+            }
+            uint64_t ticks = Now() - ticksBegin;
+            uint64_t ns = ElapsedNs(begin);
+            return ticks == 0 ? 1.0 : static_cast<double>(ns) / ticks;
+#else
+            return 1.0;
+#endif
+        }();
+        return nsPerTick;
+    }
+
+    static double ToNs(uint64_t ticks) { return ticks * NsPerTick(); }
+
+    //! @brief time between two back to back `Now`, subtracted from every call
+    static double OverheadNs() {
+        static double overhead = []() {
+            uint64_t best = std::numeric_limits<uint64_t>::max();
+            for (int i = 0; i < 10000; i++) {
+                uint64_t begin = Now();
+                best = std::min(best, Now() - begin);
+            }
+            return ToNs(best);
+        }();
+        return overhead;
+    }
+
+    static const char* Name() {
+        return BENCHMARK_HAS_TSC ? "tsc" : "steady_clock";
+    }
+};
+
+//! @brief log bucketed histogram of nanoseconds like HdrHistogram. Values
+//! below `SubBucketCount` are exact, larger values share `SubBucketCount / 2`
+//! buckets per power of two, so relative error is below 1%
+class LatencyHistogram final {
+ public:
+    static constexpr int SubBucketBits = 8;
+    static constexpr uint64_t SubBucketCount = 1ull << SubBucketBits;
+    static constexpr uint64_t SubBucketHalf = SubBucketCount / 2;
+
+    void Record(uint64_t ns) {
+        size_t index = bucketIndex(ns);
+        if (index >= counts_.size()) {
+            counts_.resize(index + 1, 0);
+        }
+        counts_[index]++;
+        count_++;
+        min_ = std::min(min_, ns);
+        max_ = std::max(max_, ns);
+    }
+
+    void Merge(const LatencyHistogram& o) {
+        if (o.counts_.size() > counts_.size()) {
+            counts_.resize(o.counts_.size(), 0);
+        }
+        for (size_t i = 0; i < o.counts_.size(); i++) {
+            counts_[i] += o.counts_[i];
+        }
+        count_ += o.count_;
+        min_ = std::min(min_, o.min_);
+        max_ = std::max(max_, o.max_);
+    }
+
+    uint64_t Count() const { return count_; }
+
+    uint64_t Min() const { return count_ == 0 ? 0 : min_; }
+
+    uint64_t Max() const { return max_; }
+
+    //! @brief value that p of recorded values are less than or equal to, a
+    //! bucket is represented by its highest value
+    uint64_t Percentile(double p) const {
+        if (count_ == 0) {
+            return 0;
+        }
+        auto rank = std::max<uint64_t>(
+            1, static_cast<uint64_t>(std::ceil(p * count_)));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < counts_.size(); i++) {
+            seen += counts_[i];
+            if (seen >= rank) {
+                return std::min(bucketHighest(i), max_);
+            }
+        }
+        return max_;
+    }
+
+ private:
+    std::vector<uint64_t> counts_;
+    uint64_t count_ = 0;
+    uint64_t min_ = std::numeric_limits<uint64_t>::max();
+    uint64_t max_ = 0;
+
+    static size_t bucketIndex(uint64_t value) {
+        if (value < SubBucketCount) {
+            return static_cast<size_t>(value);
+        }
+        int msb = 63;
+        while (!(value >> msb)) {
+            msb--;
+        }
+        int shift = msb - SubBucketBits + 1;
+        return SubBucketCount + (msb - SubBucketBits) * SubBucketHalf +
+               ((value >> shift) - SubBucketHalf);
+    }
+
+    static uint64_t bucketHighest(size_t index) {
+        if (index < SubBucketCount) {
+            return index;
+        }
+        size_t offset = index - SubBucketCount;
+        int msb = static_cast<int>(offset / SubBucketHalf) + SubBucketBits;
+        uint64_t sub = SubBucketHalf + offset % SubBucketHalf;
+        int shift = msb - SubBucketBits + 1;
+        return ((sub + 1) << shift) - 1;
+    }
+};
+
+enum class Complexity {
+    O1,
+    OLogN,
+    ON,
+    ONLogN,
+    ON2,
+};
+
+inline const char* GetComplexityName(Complexity complexity) {
+    switch (complexity) {
+        case Complexity::O1:
+            return "O(1)";
+        case Complexity::OLogN:
+            return "O(logN)";
+        case Complexity::ON:
+            return "O(N)";
+        case Complexity::ONLogN:
+            return "O(NlogN)";
+        case Complexity::ON2:
+            return "O(N^2)";
+    }
+    return "";
+}
+
+inline double EvalComplexity(Complexity complexity, double n) {
+    switch (complexity) {
+        case Complexity::O1:
+            return 1;
+        case Complexity::OLogN:
+            return std::log2(n);
+        case Complexity::ON:
+            return n;
+        case Complexity::ONLogN:
+            return n * std::log2(n);
+        case Complexity::ON2:
+            return n * n;
+    }
+    return 0;
+}
+
+//! @brief `time = coefficient * f(N)` fitted by least squares
+struct ComplexityFit final {
+    Complexity complexity;
+    double coefficient;  //!< nanoseconds
+    double rms;          //!< root mean square of relative error
+};
+
+//! @brief fit times to each complexity, return the one with minimal error
+//! @note relative error is minimized, so small N weigh as much as large N
+inline ComplexityFit FitComplexity(const std::vector<int64_t>& ns,
+                                   const std::vector<double>& times) {
+    std::optional<ComplexityFit> best;
+    for (auto complexity : {Complexity::O1, Complexity::OLogN, Complexity::ON,
+                            Complexity::ONLogN, Complexity::ON2}) {
+        // minimize sum((t - c * f) / t)^2 => c = sum(f / t) / sum((f / t)^2)
+        double sumR = 0, sumRR = 0;
+        for (size_t i = 0; i < ns.size(); i++) {
+            double f = EvalComplexity(complexity, static_cast<double>(ns[i]));
+            double ratio = times[i] == 0 ? 0 : f / times[i];
+            sumR += ratio;
+            sumRR += ratio * ratio;
+        }
+        double coefficient = sumRR == 0 ? 0 : sumR / sumRR;
+        double error = 0;
+        for (size_t i = 0; i < ns.size(); i++) {
+            if (times[i] == 0) continue;
+            double f = EvalComplexity(complexity, static_cast<double>(ns[i]));
+            double diff = 1 - coefficient * f / times[i];
+            error += diff * diff;
+        }
+        double rms = std::sqrt(error / ns.size());
+        if (!best || rms < best->rms) {
+            best = ComplexityFit{complexity, coefficient, rms};
+        }
+    }
+    return best.value();
+}
+
+enum class PerfEvent {
+    Cycles,
+    Instructions,
+    L1DMisses,
+    LLCMisses,
+    BranchMisses,
+};
+
+constexpr size_t PerfEventCount = 5;
+
+using PerfValues = std::array<std::optional<double>, PerfEventCount>;
+
+inline const char* GetPerfEventName(PerfEvent event) {
+    switch (event) {
+        case PerfEvent::Cycles:
+            return "cycles";
+        case PerfEvent::Instructions:
+            return "instructions";
+        case PerfEvent::L1DMisses:
+            return "L1D misses";
+        case PerfEvent::LLCMisses:
+            return "LLC misses";
+        case PerfEvent::BranchMisses:
+            return "branch misses";
+    }
+    return "";
+}
+
+//! @brief field name of event in JSON/CSV report
+inline const char* GetPerfEventKey(PerfEvent event) {
+    switch (event) {
+        case PerfEvent::Cycles:
+            return "cycles";
+        case PerfEvent::Instructions:
+            return "instructions";
+        case PerfEvent::L1DMisses:
+            return "l1d_misses";
+        case PerfEvent::LLCMisses:
+            return "llc_misses";
+        case PerfEvent::BranchMisses:
+            return "branch_misses";
+    }
+    return "";
+}
+
+//! @brief whether hardware counters are collected when measuring, set by
+//! `--perf` in cmdline
+inline bool& PerfCountersEnabled() {
+    static bool enabled = false;
+    return enabled;
+}
+
+//! @brief hardware counters of current thread by perf_event_open(Linux only),
+//! events can't be opened(no PMU, perf_event_paranoid, other OS) are skipped
+class PerfCounters final {
+ public:
+    PerfCounters() {
+        fds_.fill(-1);
+#if BENCHMARK_HAS_PERF_EVENT
+        for (size_t i = 0; i < PerfEventCount; i++) {
+            fds_[i] = open(static_cast<PerfEvent>(i));
+        }
+#endif
+    }
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    ~PerfCounters() {
+#if BENCHMARK_HAS_PERF_EVENT
+        for (auto fd : fds_) {
+            if (fd >= 0) close(fd);
+        }
+#endif
+    }
+
+    bool Available() const {
+        return std::any_of(fds_.begin(), fds_.end(),
+                           [](int fd) { return fd >= 0; });
+    }
+
+    void Start() {
+#if BENCHMARK_HAS_PERF_EVENT
+        for (auto fd : fds_) {
+            if (fd < 0) continue;
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+    }
+
+    //! @brief stop counting, counts are kept and `Resume` continues them
+    void Stop() {
+#if BENCHMARK_HAS_PERF_EVENT
+        for (auto fd : fds_) {
+            if (fd >= 0) ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        }
+#endif
+    }
+
+    void Resume() {
+#if BENCHMARK_HAS_PERF_EVENT
+        for (auto fd : fds_) {
+            if (fd >= 0) ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+    }
+
+    //! @brief counts since `Start`, scaled when events were multiplexed
+    PerfValues Read() const {
+        PerfValues values;
+#if BENCHMARK_HAS_PERF_EVENT
+        for (size_t i = 0; i < PerfEventCount; i++) {
+            struct {
+                uint64_t value;
+                uint64_t enabled;
+                uint64_t running;
+            } data;
+            if (fds_[i] >= 0 &&
+                read(fds_[i], &data, sizeof(data)) == sizeof(data) &&
+                data.running > 0) {
+                values[i] = static_cast<double>(data.value) * data.enabled /
+                            data.running;
+            }
+        }
+#endif
+        return values;
+    }
+
+ private:
+    std::array<int, PerfEventCount> fds_;
+
+#if BENCHMARK_HAS_PERF_EVENT
+    static int open(PerfEvent event) {
+        perf_event_attr attr{};
+        attr.size = sizeof(attr);
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format =
+            PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        switch (event) {
+            case PerfEvent::Cycles:
+                attr.type = PERF_TYPE_HARDWARE;
+                attr.config = PERF_COUNT_HW_CPU_CYCLES;
+                break;
+            case PerfEvent::Instructions:
+                attr.type = PERF_TYPE_HARDWARE;
+                attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+                break;
+            case PerfEvent::L1DMisses:
+                attr.type = PERF_TYPE_HW_CACHE;
+                attr.config = PERF_COUNT_HW_CACHE_L1D |
+                              (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                              (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+                break;
+            case PerfEvent::LLCMisses:
+                attr.type = PERF_TYPE_HARDWARE;
+                attr.config = PERF_COUNT_HW_CACHE_MISSES;
+                break;
+            case PerfEvent::BranchMisses:
+                attr.type = PERF_TYPE_HARDWARE;
+                attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+                break;
+        }
+        return static_cast<int>(
+            syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+    }
+#endif
+};
+
+//! @brief counted by the global operator new when a translation unit defines
+//! BENCHMARK_TRACK_ALLOCATIONS before including this header
+inline std::atomic<bool> allocationTracking{false};
+inline std::atomic<uint64_t> allocationCount{0};
+inline std::atomic<uint64_t> allocationBytes{0};
+//! allocations of current thread are not counted, set by `PauseTiming`
+inline thread_local bool allocationPaused = false;
+
+enum class CounterType {
+    Value,  //!< show value of one iteration
+    Rate,   //!< show value per second of all threads
+};
+
+//! @brief user defined counter of one iteration, eg: draw calls
+struct Counter final {
+    double value;
+    CounterType type;
+};
+
+//! @brief result of running a unit with one argument and thread count
+struct Result final {
+    std::optional<int64_t> arg;
+    int threads = 1;
+    Statistics stats;  //!< wall time of one iteration run by every thread
+    PerfValues perf;   //!< counts of one iteration on the first thread
+    //! heap allocations and allocated bytes of one iteration, only if
+    //! allocations are tracked
+    std::optional<double> allocations;
+    std::optional<double> allocatedBytes;
+    //! `PauseTiming` calls of one iteration and clock overhead subtracted for
+    //! every call, only if the unit pauses timing
+    std::optional<double> pauses;
+    double pauseOverhead = 0;
+    //! set by `Measure`, processed by one thread in one iteration
+    std::optional<double> bytesProcessed;
+    std::optional<double> itemsProcessed;
+    std::map<std::string, Counter> counters;
+    //! time of every call of all threads, only in latency mode
+    std::optional<LatencyHistogram> latency;
+
+    //! @brief iterations per second of all threads
+    double Throughput() const {
+        return stats.median == 0 ? 0 : threads * 1e9 / stats.median;
+    }
+
+    //! @brief per second of all threads
+    double Rate(double perIteration) const {
+        return perIteration * Throughput();
+    }
+
+    //! @brief value shown for counter, rate counter is converted to per second
+    double CounterValue(const Counter& counter) const {
+        return counter.type == CounterType::Rate ? Rate(counter.value)
+                                                 : counter.value;
+    }
+};
+
+//! @brief reusable barrier, all threads leave `Wait` together
+class Barrier final {
+ public:
+    explicit Barrier(int count) : count_(count) {}
+
+    void Wait() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        auto generation = generation_;
+        if (++waiting_ == count_) {
+            waiting_ = 0;
+            generation_++;
+            cond_.notify_all();
+        } else {
+            cond_.wait(lock, [&]() { return generation != generation_; });
+        }
+    }
+
+ private:
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    int count_;
+    int waiting_ = 0;
+    uint64_t generation_ = 0;
+};
+
+//! @brief shared by all threads running one result
+struct ThreadContext final {
+    explicit ThreadContext(int threads) : threads(threads), barrier(threads) {}
+
+    int threads;
+    Barrier barrier;
+    //! slowest thread in current round, timed and wall time
+    std::atomic<uint64_t> roundNs{0};
+    std::atomic<uint64_t> roundWallNs{0};
+    std::mutex mutex;  //!< guards merging results of threads
+};
+
+//! @brief cpu chosen by `--cpu=N` to pin comparisons on
+inline std::optional<int>& ComparisonCpu() {
+    static std::optional<int> cpu;
+    return cpu;
+}
+
+//! @brief cpu current thread runs on, -1 if unknown
+inline int CurrentCpu() {
+#ifdef __linux__
+    return sched_getcpu();
+#else
+    return -1;
+#endif
+}
+
+//! @brief pin current thread to one cpu, old affinity is restored on
+//! destruction. Linux only
+class CpuPin final {
+ public:
+    explicit CpuPin(int cpu) {
+#ifdef __linux__
+        if (cpu < 0 || cpu >= CPU_SETSIZE ||
+            sched_getaffinity(0, sizeof(old_), &old_) != 0) {
+            return;
+        }
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        pinned_ = sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+        (void)cpu;
+#endif
+    }
+
+    CpuPin(const CpuPin&) = delete;
+    CpuPin& operator=(const CpuPin&) = delete;
+
+    ~CpuPin() {
+#ifdef __linux__
+        if (pinned_) {
+            sched_setaffinity(0, sizeof(old_), &old_);
+        }
+#endif
+    }
+
+    bool Pinned() const { return pinned_; }
+
+ private:
+    bool pinned_ = false;
+#ifdef __linux__
+    cpu_set_t old_;
+#endif
+};
+
+//! @brief reasons that make timing unreliable: cpu frequency scaling and
+//! high system load. Linux only
+inline std::vector<std::string> CheckSystemNoise() {
+    std::vector<std::string> warnings;
+#ifdef __linux__
+    unsigned cpus = std::max(1u, std::thread::hardware_concurrency());
+    std::map<std::string, int> governors;
+    for (unsigned i = 0; i < cpus; i++) {
+        std::ifstream file("/sys/devices/system/cpu/cpu" + std::to_string(i) +
+                           "/cpufreq/scaling_governor");
+        std::string governor;
+        if (file >> governor && governor != "performance") {
+            governors[governor]++;
+        }
+    }
+    for (auto& [governor, count] : governors) {
+        warnings.push_back("cpu frequency scaling is enabled(governor " +
+                           governor + " on " + std::to_string(count) +
+                           " cpus), set governor to performance");
+    }
+    // this process is one of the running tasks
+    std::ifstream loadavg("/proc/loadavg");
+    double load = 0;
+    if (loadavg >> load && load - 1 > cpus / 2.0) {
+        std::ostringstream stream;
+        stream << "system load is high(" << load << " on " << cpus
+               << " cpus), other tasks disturb timing";
+        warnings.push_back(stream.str());
+    }
+#endif
+    return warnings;
+}
+
+//! @brief result of comparing two functions run alternately
+struct ComparisonResult final {
+    Statistics a;  //!< time of one iteration of each function
+    Statistics b;
+    //! time of a / time of b, geometric mean of ratios of adjacent samples,
+    //! greater than 1 if b is faster
+    double speedup = 1;
+    double lower = 1;  //!< 95% confidence interval of speedup
+    double upper = 1;
+    std::optional<int> cpu;  //!< pinned cpu
+    std::vector<std::string> warnings;
+};
+
+//! @brief two functions measured alternately, so frequency and thermal drift
+//! hit both equally
+struct Comparison final {
+    Comparison(std::string_view nameA, BenchmarkFunc a, std::string_view nameB,
+               BenchmarkFunc b)
+        : nameA(nameA), nameB(nameB), a(std::move(a)), b(std::move(b)) {}
+
+    //! @brief pin to cpu while comparing, default is `--cpu=N` or the cpu
+    //! the benchmark thread runs on
+    Comparison& Cpu(int n) {
+        cpu = n;
+        return *this;
+    }
+
+    std::string Name() const {
+        return std::string(nameA) + " vs " + std::string(nameB);
+    }
+
+    std::string_view nameA;
+    std::string_view nameB;
+    BenchmarkFunc a;
+    BenchmarkFunc b;
+    std::optional<int> cpu;
+    std::optional<ComparisonResult> result;
+};
 
 struct Unit final {
     Unit(std::string_view name, BenchmarkFunc func)
-        : name(name), func(func), time(0) {}
+        : name(name), func(func) {}
     Unit(std::string_view name, BenchmarkFuncWithOp func)
-        : name(name), funcWithOp(func), time(0) {}
+        : name(name), funcWithOp(func) {}
+
+    //! @brief run unit with arguments `lo, lo * multiplier, ...` below `hi`,
+    //! then `hi` itself, eg: `Range(8, 100, 4)` runs 8, 32 and 100
+    //! @note `lo` is clamped to at least 1, `multiplier` to at least 2 and
+    //! `hi` to at least `lo`, so the range is never endless
+    Unit& Range(int64_t lo, int64_t hi, int64_t multiplier = 2) {
+        lo = std::max<int64_t>(lo, 1);
+        hi = std::max(hi, lo);
+        multiplier = std::max<int64_t>(multiplier, 2);
+        args.clear();
+        for (int64_t arg = lo; arg < hi; arg *= multiplier) {
+            args.push_back(arg);
+            // next step is beyond `hi`, stop before multiplying overflows
+            if (arg > hi / multiplier) {
+                break;
+            }
+        }
+        args.push_back(hi);
+        return *this;
+    }
+
+    //! @brief run unit with each argument
+    Unit& Args(std::initializer_list<int64_t> values) {
+        args = values;
+        return *this;
+    }
+
+    //! @brief also run unit on n threads at the same time, one thread is
+    //! always run to compare scaling
+    //! @note the function of unit is called on every thread, every thread must
+    //! call `Measure::operator()` once
+    Unit& Threads(int n) {
+        if (threads.empty()) {
+            threads.push_back(1);
+        }
+        if (std::find(threads.begin(), threads.end(), n) == threads.end()) {
+            threads.push_back(n);
+            std::sort(threads.begin(), threads.end());
+        }
+        return *this;
+    }
+
+    //! @brief time every call on its own and report percentiles of call
+    //! time, for code whose tail latency matters(eg: a frame update)
+    //! @note timing every call costs a few nanoseconds, the body should take
+    //! much longer than `TscClock::OverheadNs()`
+    Unit& Latency() {
+        latency = true;
+        return *this;
+    }
+
+    //! @brief called before measuring each argument and thread count, out of
+    //! timing. Only called once when unit runs on multiple threads
+    Unit& Setup(FixtureFunc func) {
+        setup = std::move(func);
+        return *this;
+    }
+
+    //! @brief called after measuring each argument and thread count
+    Unit& Teardown(FixtureFunc func) {
+        teardown = std::move(func);
+        return *this;
+    }
 
     std::string_view name;
     BenchmarkFunc func;
     BenchmarkFuncWithOp funcWithOp;
-    uint64_t time;
+    FixtureFunc setup;
+    FixtureFunc teardown;
+    std::vector<int64_t> args;
+    std::vector<int> threads;
+    bool latency = false;
+    std::vector<Result> results;
+    std::optional<ComplexityFit> complexity;  //!< fitted when args >= 2
 };
 
 class Measure final {
  public:
-    explicit Measure(Unit& unit) : unit_(unit) {}
+    explicit Measure(Result& result, ThreadContext* context = nullptr,
+                     int threadIndex = 0)
+        : result_(result),
+          context_(context),
+          threadIndex_(threadIndex),
+          latency_(result.latency.has_value()) {}
+
+    //! @brief argument of current run, unit must have arguments
+    int64_t Arg() const { return result_.arg.value(); }
+
+    //! @brief count of threads running the unit
+    int Threads() const { return result_.threads; }
 
-    void operator()(BenchmarkFunc func) const {
-        auto begin = std::chrono::steady_clock::now();
-        if (func) {
-            for (uint64_t i = 0; i < BENCHMARK_REPEAT_NUM; i++) {
-                (void)func();
+    //! @brief index of current thread in [0, Threads())
+    int ThreadIndex() const { return threadIndex_; }
+
+    //! @brief bytes processed in one iteration, bytes per second is reported
+    //! @note only values set by the first thread are kept
+    void SetBytesProcessed(double bytes) const {
+        if (threadIndex_ == 0) result_.bytesProcessed = bytes;
+    }
+
+    //! @brief items processed in one iteration, items per second and time
+    //! of one item are reported
+    void SetItemsProcessed(double items) const {
+        if (threadIndex_ == 0) result_.itemsProcessed = items;
+    }
+
+    //! @brief set a named counter of one iteration, eg: draw calls
+    void SetCounter(const std::string& name, double value,
+                    CounterType type = CounterType::Value) const {
+        if (threadIndex_ == 0) result_.counters[name] = Counter{value, type};
+    }
+
+    //! @brief stop timing in measured func, eg: rebuild state for the next
+    //! iteration. Must be paired with `ResumeTiming`
+    //! @note cost of reading clock is subtracted from measured time,
+    //! allocations of this thread and perf counters stop until `ResumeTiming`
+    void PauseTiming() const {
+        pauseBegin_ = Clock::now();
+        allocationPaused = true;
+        if (perf_) perf_->Stop();
+    }
+
+    //! @brief resume timing stopped by `PauseTiming`
+    void ResumeTiming() const {
+        if (perf_) perf_->Resume();
+        allocationPaused = false;
+        pausedNs_ += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                         Clock::now() - pauseBegin_)
+                         .count();
+        pauseCount_++;
+    }
+
+    //! @brief warmup, calibrate iterations and collect samples of func
+    //! @note the return value of func is passed to `DoNotOptimize`
+    template <typename F>
+    void operator()(F&& func) const {
+        // sum of round wall time, decisions only depend on round time so all
+        // threads make the same decisions
+        uint64_t elapsed = 0;
+        uint64_t iterations = BENCHMARK_REPEAT_NUM;
+
+        if (iterations == 0) {
+            // grow iterations until one sample reaches target time, the
+            // limit stops growing when the body was optimized away
+            constexpr uint64_t target = BENCHMARK_SAMPLE_TIME_MS * 1000000ull;
+            constexpr uint64_t maxIterations = 1000000000ull;
+            iterations = 1;
+            auto round = runRound(func, iterations);
+            elapsed += round.wall;
+            while (round.timed < target && round.wall < target * 100 &&
+                   iterations < maxIterations) {
+                double factor = round.timed == 0
+                                    ? 10.0
+                                    : std::min(10.0, 1.2 * target / round.timed);
+                iterations = std::max(iterations + 1,
+                                      static_cast<uint64_t>(iterations * factor));
+                round = runRound(func, iterations);
+                elapsed += round.wall;
             }
         }
-        unit_.time = std::chrono::duration_cast<std::chrono::milliseconds>(
-                         std::chrono::steady_clock::now() - begin)
-                         .count();
+
+        while (elapsed < BENCHMARK_WARMUP_MS * 1000000ull) {
+            elapsed += runRound(func, iterations).wall;
+        }
+
+        std::optional<PerfCounters> perf;
+        if (PerfCountersEnabled() && threadIndex_ == 0) {
+            perf.emplace();
+            perf->Start();
+            perf_ = &perf.value();
+        }
+
+        // every thread records its calls, merged after sampling
+        std::optional<LatencyHistogram> histogram;
+        if (latency_) {
+            histogram.emplace();
+            histogram_ = &histogram.value();
+        }
+
+        std::vector<double> samples;
+        samples.reserve(BENCHMARK_SAMPLE_NUM);
+        uint64_t allocationCountBegin = allocationCount.load();
+        uint64_t allocationBytesBegin = allocationBytes.load();
+        sampledPauses_ = 0;
+        if (pauseOverhead_) {
+            // calibrate again when the cpu is warm, like it is in samples
+            pauseOverhead_ = calibratePauseOverhead();
+        }
+        for (uint64_t i = 0; i < BENCHMARK_SAMPLE_NUM; i++) {
+            auto round = runRound(func, iterations);
+            elapsed += round.wall;
+            samples.push_back(static_cast<double>(round.timed) / iterations);
+            if (elapsed > BENCHMARK_MAX_TIME_MS * 1000000ull) {
+                break;
+            }
+        }
+        histogram_ = nullptr;
+        if (histogram) {
+            if (context_) {
+                std::lock_guard<std::mutex> lock(context_->mutex);
+                result_.latency->Merge(histogram.value());
+            } else {
+                result_.latency->Merge(histogram.value());
+            }
+        }
+        if (allocationTracking && threadIndex_ == 0) {
+            // allocations of all threads are counted
+            double count = static_cast<double>(samples.size()) * iterations *
+                           result_.threads;
+            result_.allocations =
+                (allocationCount.load() - allocationCountBegin) / count;
+            result_.allocatedBytes =
+                (allocationBytes.load() - allocationBytesBegin) / count;
+        }
+        if (sampledPauses_ > 0 && threadIndex_ == 0) {
+            result_.pauses = static_cast<double>(sampledPauses_) /
+                             (samples.size() * iterations);
+            result_.pauseOverhead = pauseOverhead_.value();
+        }
+        if (perf) {
+            perf_ = nullptr;
+            perf->Stop();
+            result_.perf = perf->Read();
+            for (auto& value : result_.perf) {
+                if (value) {
+                    value = value.value() / (samples.size() * iterations);
+                }
+            }
+        }
+        if (threadIndex_ == 0) {
+            result_.stats = Statistics::Compute(std::move(samples), iterations);
+        }
     }
 
  private:
-    Unit& unit_;
+    //! @brief time of a batch, timed excludes paused time
+    struct RoundTime final {
+        uint64_t timed;
+        uint64_t wall;
+    };
+
+    Result& result_;
+    ThreadContext* context_;
+    int threadIndex_;
+    bool latency_;
+    //! records calls while collecting samples in latency mode
+    mutable LatencyHistogram* histogram_ = nullptr;
+    mutable Clock::time_point pauseBegin_;
+    mutable uint64_t pausedNs_ = 0;
+    mutable uint64_t pauseCount_ = 0;
+    //! pauses while collecting samples
+    mutable uint64_t sampledPauses_ = 0;
+    //! counters of the first thread while collecting samples, paused together
+    //! with timing
+    mutable PerfCounters* perf_ = nullptr;
+    //! time of a `PauseTiming`/`ResumeTiming` pair still counted as timed,
+    //! calibrated when the unit first pauses
+    mutable std::optional<double> pauseOverhead_;
+
+    //! @note median of rounds rather than the fastest one, the fastest round
+    //! underestimates the usual overhead and leaves a bias in paused units
+    static double calibratePauseOverhead() {
+        constexpr uint64_t iterations = 1000;
+        constexpr int rounds = 31;
+        Result result;
+        Measure measure(result);
+        std::vector<double> overheads;
+        for (int i = 0; i < rounds; i++) {
+            measure.pausedNs_ = 0;
+            auto begin = Clock::now();
+            for (uint64_t j = 0; j < iterations; j++) {
+                measure.PauseTiming();
+                measure.ResumeTiming();
+            }
+            uint64_t wall = ElapsedNs(begin);
+            uint64_t timed = wall - std::min(wall, measure.pausedNs_);
+            overheads.push_back(static_cast<double>(timed) / iterations);
+        }
+        std::nth_element(overheads.begin(), overheads.begin() + rounds / 2,
+                         overheads.end());
+        return overheads[rounds / 2];
+    }
+
+    static void updateMax(std::atomic<uint64_t>& slowest, uint64_t ns) {
+        uint64_t old = slowest.load();
+        while (old < ns && !slowest.compare_exchange_weak(old, ns)) {
+        }
+    }
+
+    //! @brief run a batch on every thread together, return time of the
+    //! slowest thread
+    template <typename F>
+    RoundTime runRound(F& func, uint64_t iterations) const {
+        if (!context_) {
+            return runBatch(func, iterations);
+        }
+        context_->barrier.Wait();
+        auto round = runBatch(func, iterations);
+        updateMax(context_->roundNs, round.timed);
+        updateMax(context_->roundWallNs, round.wall);
+        context_->barrier.Wait();
+        round = RoundTime{context_->roundNs.load(),
+                          context_->roundWallNs.load()};
+        context_->barrier.Wait();
+        if (threadIndex_ == 0) {
+            context_->roundNs = 0;
+            context_->roundWallNs = 0;
+        }
+        return round;
+    }
+
+    template <typename F>
+    static void call(F& func) {
+        if constexpr (std::is_void_v<decltype(func())>) {
+            func();
+        } else {
+            DoNotOptimize(func());
+        }
+    }
+
+    //! @brief paused time since counters were reset
+    double excludedNs() const {
+        if (pauseCount_ == 0) {
+            return 0;
+        }
+        if (!pauseOverhead_) {
+            pauseOverhead_ = calibratePauseOverhead();
+        }
+        return pausedNs_ + pauseCount_ * pauseOverhead_.value();
+    }
+
+    template <typename F>
+    RoundTime runBatch(F& func, uint64_t iterations) const {
+        if (latency_) {
+            return runCalls(func, iterations);
+        }
+        pausedNs_ = 0;
+        pauseCount_ = 0;
+        auto begin = Clock::now();
+        for (uint64_t i = 0; i < iterations; i++) {
+            call(func);
+        }
+        uint64_t wall = ElapsedNs(begin);
+        sampledPauses_ += pauseCount_;
+        double excluded = excludedNs();
+        uint64_t timed = excluded >= wall
+                             ? 0
+                             : wall - static_cast<uint64_t>(excluded);
+        return RoundTime{timed, wall};
+    }
+
+    //! @brief time every call with `TscClock`, timed is the sum of calls
+    //! without clock overhead
+    template <typename F>
+    RoundTime runCalls(F& func, uint64_t iterations) const {
+        double overhead = TscClock::OverheadNs();
+        double timed = 0;
+        auto begin = Clock::now();
+        for (uint64_t i = 0; i < iterations; i++) {
+            pausedNs_ = 0;
+            pauseCount_ = 0;
+            uint64_t callBegin = TscClock::Now();
+            call(func);
+            uint64_t ticks = TscClock::Now() - callBegin;
+            sampledPauses_ += pauseCount_;
+            double ns = std::max(
+                0.0, TscClock::ToNs(ticks) - overhead - excludedNs());
+            timed += ns;
+            if (histogram_) {
+                histogram_->Record(static_cast<uint64_t>(ns + 0.5));
+            }
+        }
+        return RoundTime{static_cast<uint64_t>(timed), ElapsedNs(begin)};
+    }
 };
 
 class Group final {
@@ -63,48 +1312,863 @@ class Group final {
 
     void Add(const Unit& unit) { units_.push_back(unit); }
 
-    void DoBenchmark() {
-        std::cout << "running group " << name_ << std::endl;
+    void Add(const Comparison& comparison) {
+        comparisons_.push_back(comparison);
+    }
+
+    std::string_view Name() const { return name_; }
+
+    const std::vector<Unit>& Units() const { return units_; }
+
+    const std::vector<Comparison>& Comparisons() const { return comparisons_; }
+
+    void DoBenchmark(std::ostream& log = std::cout) {
+        log << "running group " << name_ << std::endl;
         for (auto& unit : units_) {
-            std::cout << "measuring " << unit.name << " ...";
-            if (unit.func) {
-                measureOneUnit(unit);
-            } else {
-                measureOneUnitWithExtraOp(unit);
+            unit.results.clear();
+            unit.complexity = std::nullopt;
+            std::vector<std::optional<int64_t>> args(unit.args.begin(),
+                                                     unit.args.end());
+            if (args.empty()) {
+                args.push_back(std::nullopt);
+            }
+            std::vector<int> threads = unit.threads;
+            if (threads.empty()) {
+                threads.push_back(1);
             }
-            std::cout << std::endl;
+            for (auto arg : args) {
+                for (auto threadNum : threads) {
+                    auto& result = unit.results.emplace_back();
+                    result.arg = arg;
+                    result.threads = threadNum;
+                    if (unit.latency) {
+                        result.latency.emplace();
+                    }
+                    log << "measuring " << GetResultName(unit, result)
+                        << " ...";
+                    measureOneResult(unit, result);
+                    log << std::endl;
+                }
+            }
+            if (!unit.args.empty()) {
+                fitComplexity(unit);
+            }
+        }
+        for (auto& comparison : comparisons_) {
+            log << "comparing " << comparison.Name() << " ...";
+            measureComparison(comparison);
+            log << std::endl;
+        }
+    }
+
+    //! @brief unit name with argument and thread count, eg: `insert/1024/threads:4`
+    static std::string GetResultName(const Unit& unit, const Result& result) {
+        std::string name(unit.name);
+        if (result.arg) {
+            name += "/" + std::to_string(result.arg.value());
+        }
+        if (!unit.threads.empty()) {
+            name += "/threads:" + std::to_string(result.threads);
         }
+        return name;
     }
 
-    void ShowResult() {
+    void ShowResult(std::ostream& o = std::cout) const {
         for (auto& unit : units_) {
-            std::cout << unit.name << ":" << std::endl;
-            std::cout << "\ttotle time: " << unit.time << "ms" << std::endl;
-            std::cout << "\taverage time: "
-                      << unit.time / static_cast<float>(BENCHMARK_REPEAT_NUM)
-                      << "ms" << std::endl;
-            std::cout << std::endl;
+            for (auto& result : unit.results) {
+                showOneResult(o, unit, result);
+            }
+            if (unit.complexity) {
+                o << unit.name << " complexity: "
+                  << GetComplexityName(unit.complexity->complexity)
+                  << "\tcoefficient: " << std::setprecision(4)
+                  << unit.complexity->coefficient << "ns"
+                  << "\trms: " << std::setprecision(1) << std::fixed
+                  << unit.complexity->rms * 100 << "%" << std::defaultfloat
+                  << std::setprecision(6) << std::endl;
+                o << std::endl;
+            }
+        }
+        for (auto& comparison : comparisons_) {
+            showComparison(o, comparison);
         }
     }
 
  private:
     std::vector<Unit> units_;
+    std::vector<Comparison> comparisons_;
     std::string_view name_;
 
-    void measureOneUnit(Unit& unit) const {
+    void measureOneResult(Unit& unit, Result& result) const {
+        if (unit.setup) {
+            unit.setup(Measure{result});
+        }
+
+        if (result.threads == 1) {
+            runOnThread(unit, Measure{result});
+        } else {
+            ThreadContext context(result.threads);
+            std::vector<std::thread> threads;
+            for (int i = 1; i < result.threads; i++) {
+                threads.emplace_back([&, i]() {
+                    runOnThread(unit, Measure{result, &context, i});
+                });
+            }
+            runOnThread(unit, Measure{result, &context, 0});
+            for (auto& thread : threads) {
+                thread.join();
+            }
+        }
+
+        if (unit.teardown) {
+            unit.teardown(Measure{result});
+        }
+    }
+
+    //! @brief run batches of two functions alternately in ABBA order, so
+    //! linear drift is cancelled in every two pairs
+    void measureComparison(Comparison& comparison) const {
+        auto& result = comparison.result.emplace();
+        result.warnings = CheckSystemNoise();
+        int cpu = comparison.cpu.value_or(
+            ComparisonCpu().value_or(CurrentCpu()));
+        CpuPin pin(cpu);
+        if (pin.Pinned()) {
+            result.cpu = cpu;
+        } else {
+            result.warnings.push_back("can't pin thread to cpu " +
+                                      std::to_string(cpu));
+        }
+
+        uint64_t iterationsA = calibrate(comparison.a);
+        uint64_t iterationsB = calibrate(comparison.b);
+        uint64_t elapsed = 0;
+        while (elapsed < BENCHMARK_WARMUP_MS * 1000000ull) {
+            elapsed += timeBatch(comparison.a, iterationsA) +
+                       timeBatch(comparison.b, iterationsB);
+        }
+
+        std::vector<double> samplesA, samplesB, logRatios;
+        for (uint64_t i = 0; i < BENCHMARK_SAMPLE_NUM; i++) {
+            uint64_t nsA, nsB;
+            if (i % 2 == 0) {
+                nsA = timeBatch(comparison.a, iterationsA);
+                nsB = timeBatch(comparison.b, iterationsB);
+            } else {
+                nsB = timeBatch(comparison.b, iterationsB);
+                nsA = timeBatch(comparison.a, iterationsA);
+            }
+            elapsed += nsA + nsB;
+            double a = static_cast<double>(nsA) / iterationsA;
+            double b = static_cast<double>(nsB) / iterationsB;
+            samplesA.push_back(a);
+            samplesB.push_back(b);
+            if (a > 0 && b > 0) {
+                logRatios.push_back(std::log(a / b));
+            }
+            // two functions share the time limit of two units
+            if (elapsed > 2 * BENCHMARK_MAX_TIME_MS * 1000000ull) {
+                break;
+            }
+        }
+        result.a = Statistics::Compute(std::move(samplesA), iterationsA);
+        result.b = Statistics::Compute(std::move(samplesB), iterationsB);
+
+        // ratios are skewed, confidence interval is computed on logarithm
+        if (!logRatios.empty()) {
+            size_t n = logRatios.size();
+            auto ratios = Statistics::Compute(std::move(logRatios), 1);
+            double margin =
+                n < 2 ? 0
+                      : StudentTCritical(0.05, n - 1) * ratios.stddev /
+                            std::sqrt(static_cast<double>(n));
+            result.speedup = std::exp(ratios.mean);
+            result.lower = std::exp(ratios.mean - margin);
+            result.upper = std::exp(ratios.mean + margin);
+        }
+    }
+
+    //! @brief iterations making one batch of func take about sample time
+    static uint64_t calibrate(const BenchmarkFunc& func) {
+        if (BENCHMARK_REPEAT_NUM != 0) {
+            return BENCHMARK_REPEAT_NUM;
+        }
+        constexpr uint64_t target = BENCHMARK_SAMPLE_TIME_MS * 1000000ull;
+        constexpr uint64_t maxIterations = 1000000000ull;
+        uint64_t iterations = 1;
+        uint64_t ns = timeBatch(func, iterations);
+        while (ns < target && iterations < maxIterations) {
+            double factor =
+                ns == 0 ? 10.0 : std::min(10.0, 1.2 * target / ns);
+            iterations = std::max(iterations + 1,
+                                  static_cast<uint64_t>(iterations * factor));
+            ns = timeBatch(func, iterations);
+        }
+        return iterations;
+    }
+
+    static uint64_t timeBatch(const BenchmarkFunc& func, uint64_t iterations) {
+        auto begin = Clock::now();
+        for (uint64_t i = 0; i < iterations; i++) {
+            func();
+        }
+        return ElapsedNs(begin);
+    }
+
+    static void runOnThread(Unit& unit, Measure measure) {
         if (unit.func) {
-            Measure measure(unit);
             measure(unit.func);
+        } else if (unit.funcWithOp) {
+            unit.funcWithOp(measure);
+        }
+    }
+
+    static void showProcessed(std::ostream& o, const Result& result) {
+        if (result.bytesProcessed) {
+            o << "\tbytes: "
+              << FormatBytesRate(result.Rate(result.bytesProcessed.value()));
+        }
+        if (result.itemsProcessed) {
+            o << "\titems: "
+              << FormatRate(result.Rate(result.itemsProcessed.value()))
+              << "items/s";
+            if (result.itemsProcessed.value() > 0) {
+                o << "\ttime/item: "
+                  << FormatTime(result.stats.median /
+                                result.itemsProcessed.value());
+            }
+        }
+        if (result.bytesProcessed || result.itemsProcessed) {
+            o << std::endl;
+        }
+        if (result.counters.empty()) {
+            return;
+        }
+        const char* separator = "\t";
+        for (auto& [name, counter] : result.counters) {
+            o << separator << name << ": ";
+            if (counter.type == CounterType::Rate) {
+                o << FormatRate(result.CounterValue(counter)) << "/s";
+            } else {
+                o << counter.value;
+            }
+            separator = "  ";
+        }
+        o << std::endl;
+    }
+
+    static void showLatency(std::ostream& o, const LatencyHistogram& latency) {
+        o << "\tcalls: " << latency.Count() << "\tclock: " << TscClock::Name()
+          << "(overhead " << FormatTime(TscClock::OverheadNs())
+          << " subtracted)" << std::endl;
+        o << "\tcall p50: " << FormatTime(latency.Percentile(0.5))
+          << "\tp99: " << FormatTime(latency.Percentile(0.99))
+          << "\tp99.9: " << FormatTime(latency.Percentile(0.999))
+          << "\tmax: " << FormatTime(latency.Max()) << std::endl;
+    }
+
+    static void showPerfCounters(std::ostream& o, const PerfValues& perf) {
+        if (std::none_of(perf.begin(), perf.end(),
+                         [](auto& value) { return value.has_value(); })) {
+            return;
+        }
+        o << std::fixed << std::setprecision(2);
+        const char* separator = "\t";
+        for (size_t i = 0; i < PerfEventCount; i++) {
+            if (perf[i]) {
+                o << separator << GetPerfEventName(static_cast<PerfEvent>(i))
+                  << ": " << perf[i].value();
+                separator = "  ";
+            }
+        }
+        auto cycles = perf[static_cast<size_t>(PerfEvent::Cycles)];
+        auto instructions = perf[static_cast<size_t>(PerfEvent::Instructions)];
+        if (cycles && instructions && cycles.value() > 0) {
+            o << separator << "IPC: " << instructions.value() / cycles.value();
+        }
+        o << std::defaultfloat << std::setprecision(6) << std::endl;
+    }
+
+    static void showComparison(std::ostream& o, const Comparison& comparison) {
+        o << comparison.Name() << ":" << std::endl;
+        if (!comparison.result) {
+            o << "\tnot measured" << std::endl << std::endl;
+            return;
+        }
+        auto& result = comparison.result.value();
+        o << "\tsamples: " << result.a.samples.size()
+          << " pairs run alternately";
+        if (result.cpu) {
+            o << "\tpinned cpu: " << result.cpu.value();
+        }
+        o << std::endl;
+        o << "\t" << comparison.nameA
+          << " median: " << FormatTime(result.a.median) << "\t"
+          << comparison.nameB << " median: " << FormatTime(result.b.median)
+          << std::endl;
+        o << "\tspeedup: " << std::fixed << std::setprecision(3)
+          << result.speedup << "x\t95% CI: [" << result.lower << "x, "
+          << result.upper << "x]\t" << std::defaultfloat
+          << std::setprecision(6);
+        if (result.lower > 1) {
+            o << comparison.nameB << " is faster";
+        } else if (result.upper < 1) {
+            o << comparison.nameA << " is faster";
+        } else {
+            o << "no significant difference";
+        }
+        o << std::endl;
+        for (auto& warning : result.warnings) {
+            o << "\twarning: " << warning << std::endl;
+        }
+        o << std::endl;
+    }
+
+    //! @brief result of the same argument on one thread
+    static const Result* findSingleThread(const Unit& unit,
+                                          const Result& result) {
+        for (auto& other : unit.results) {
+            if (other.arg == result.arg && other.threads == 1) {
+                return &other;
+            }
+        }
+        return nullptr;
+    }
+
+    void fitComplexity(Unit& unit) const {
+        std::vector<int64_t> ns;
+        std::vector<double> times;
+        for (auto& result : unit.results) {
+            if (result.threads == 1 && !result.stats.samples.empty()) {
+                ns.push_back(result.arg.value());
+                times.push_back(result.stats.median);
+            }
+        }
+        if (ns.size() >= 2) {
+            unit.complexity = FitComplexity(ns, times);
+        }
+    }
+
+    void showOneResult(std::ostream& o, const Unit& unit,
+                       const Result& result) const {
+        auto& stats = result.stats;
+        o << GetResultName(unit, result) << ":" << std::endl;
+        if (stats.samples.empty()) {
+            o << "\tnot measured" << std::endl << std::endl;
+            return;
+        }
+        o << "\tsamples: " << stats.samples.size()
+          << " x iterations: " << stats.iterations << std::endl;
+        o << "\tmin: " << FormatTime(stats.min)
+          << "\tmedian: " << FormatTime(stats.median)
+          << "\tmean: " << FormatTime(stats.mean)
+          << "\tstddev: " << FormatTime(stats.stddev) << std::endl;
+        o << "\tp90: " << FormatTime(stats.p90)
+          << "\tp99: " << FormatTime(stats.p99)
+          << "\tmax: " << FormatTime(stats.max) << std::endl;
+        if (result.latency) {
+            showLatency(o, result.latency.value());
+        }
+        showPerfCounters(o, result.perf);
+        if (result.allocations) {
+            o << "\tallocations: " << std::fixed << std::setprecision(2)
+              << result.allocations.value()
+              << "\tallocated bytes: " << result.allocatedBytes.value()
+              << std::defaultfloat << std::setprecision(6) << std::endl;
+        }
+        if (result.pauses) {
+            double subtracted = result.pauses.value() * result.pauseOverhead;
+            o << "\tpauses: " << std::fixed << std::setprecision(2)
+              << result.pauses.value() << "\tpause overhead: "
+              << FormatTime(result.pauseOverhead) << std::defaultfloat
+              << std::setprecision(6);
+            // time left after subtraction is within the noise of the clock
+            if (subtracted > stats.median) {
+                o << "\t(timed part is shorter than pause overhead, "
+                     "result is unreliable)";
+            }
+            o << std::endl;
+        }
+        showProcessed(o, result);
+        if (!unit.threads.empty()) {
+            o << "\tthroughput: " << FormatRate(result.Throughput())
+              << "/s\tper thread: "
+              << FormatRate(result.Throughput() / result.threads) << "/s";
+            auto single = findSingleThread(unit, result);
+            if (single && single->Throughput() > 0) {
+                double scaling = result.Throughput() / single->Throughput();
+                o << "\tscaling: " << std::fixed << std::setprecision(2)
+                  << scaling << "x(" << std::setprecision(1)
+                  << scaling / result.threads * 100 << "%)"
+                  << std::defaultfloat << std::setprecision(6);
+            }
+            o << std::endl;
+        }
+        o << std::endl;
+    }
+};
+
+//! @brief a minimal JSON value, enough to read reports back
+struct JsonValue final {
+    enum class Type { Null, Bool, Number, String, Array, Object };
+
+    Type type = Type::Null;
+    bool boolean = false;
+    double number = 0;
+    std::string string;
+    std::vector<JsonValue> array;
+    std::vector<std::pair<std::string, JsonValue>> object;
+
+    const JsonValue* Find(std::string_view key) const {
+        for (auto& [name, value] : object) {
+            if (name == key) return &value;
+        }
+        return nullptr;
+    }
+};
+
+class JsonParser final {
+ public:
+    static std::optional<JsonValue> Parse(std::string_view text) {
+        JsonParser parser(text);
+        JsonValue value;
+        if (!parser.parseValue(value)) return std::nullopt;
+        parser.skipSpace();
+        if (parser.pos_ != text.size()) return std::nullopt;
+        return value;
+    }
+
+ private:
+    std::string_view text_;
+    size_t pos_ = 0;
+
+    explicit JsonParser(std::string_view text) : text_(text) {}
+
+    void skipSpace() {
+        while (pos_ < text_.size() &&
+               std::isspace(static_cast<unsigned char>(text_[pos_]))) {
+            pos_++;
+        }
+    }
+
+    bool consume(char c) {
+        skipSpace();
+        if (pos_ < text_.size() && text_[pos_] == c) {
+            pos_++;
+            return true;
+        }
+        return false;
+    }
+
+    bool consumeWord(std::string_view word) {
+        if (text_.substr(pos_, word.size()) == word) {
+            pos_ += word.size();
+            return true;
+        }
+        return false;
+    }
+
+    bool parseValue(JsonValue& value) {
+        skipSpace();
+        if (pos_ >= text_.size()) return false;
+        char c = text_[pos_];
+        if (c == '{') return parseObject(value);
+        if (c == '[') return parseArray(value);
+        if (c == '"') {
+            value.type = JsonValue::Type::String;
+            return parseString(value.string);
+        }
+        if (consumeWord("null")) {
+            value.type = JsonValue::Type::Null;
+            return true;
+        }
+        if (consumeWord("true")) {
+            value.type = JsonValue::Type::Bool;
+            value.boolean = true;
+            return true;
+        }
+        if (consumeWord("false")) {
+            value.type = JsonValue::Type::Bool;
+            value.boolean = false;
+            return true;
+        }
+        return parseNumber(value);
+    }
+
+    bool parseObject(JsonValue& value) {
+        value.type = JsonValue::Type::Object;
+        pos_++;
+        if (consume('}')) return true;
+        do {
+            std::string key;
+            JsonValue member;
+            skipSpace();
+            if (!parseString(key) || !consume(':') || !parseValue(member)) {
+                return false;
+            }
+            value.object.emplace_back(std::move(key), std::move(member));
+        } while (consume(','));
+        return consume('}');
+    }
+
+    bool parseArray(JsonValue& value) {
+        value.type = JsonValue::Type::Array;
+        pos_++;
+        if (consume(']')) return true;
+        do {
+            if (!parseValue(value.array.emplace_back())) return false;
+        } while (consume(','));
+        return consume(']');
+    }
+
+    bool parseString(std::string& out) {
+        if (pos_ >= text_.size() || text_[pos_] != '"') return false;
+        pos_++;
+        while (pos_ < text_.size() && text_[pos_] != '"') {
+            char c = text_[pos_++];
+            if (c != '\\') {
+                out += c;
+                continue;
+            }
+            if (pos_ >= text_.size()) return false;
+            char escaped = text_[pos_++];
+            switch (escaped) {
+                case 'n': out += '\n'; break;
+                case 't': out += '\t'; break;
+                case 'r': out += '\r'; break;
+                case 'b': out += '\b'; break;
+                case 'f': out += '\f'; break;
+                case 'u': {
+                    // only ASCII is written by reporters, others are kept as
+                    // UTF-8 of one code unit
+                    if (pos_ + 4 > text_.size()) return false;
+                    uint32_t code = 0;
+                    for (size_t i = 0; i < 4; i++) {
+                        int digit = hexDigit(text_[pos_ + i]);
+                        if (digit < 0) return false;
+                        code = code * 16 + static_cast<uint32_t>(digit);
+                    }
+                    pos_ += 4;
+                    appendUtf8(out, code);
+                    break;
+                }
+                default: out += escaped; break;
+            }
+        }
+        return consume('"');
+    }
+
+    static int hexDigit(char c) {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    }
+
+    static void appendUtf8(std::string& out, uint32_t code) {
+        if (code < 0x80) {
+            out += static_cast<char>(code);
+        } else if (code < 0x800) {
+            out += static_cast<char>(0xC0 | (code >> 6));
+            out += static_cast<char>(0x80 | (code & 0x3F));
+        } else {
+            out += static_cast<char>(0xE0 | (code >> 12));
+            out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (code & 0x3F));
+        }
+    }
+
+    bool parseNumber(JsonValue& value) {
+        size_t begin = pos_;
+        while (pos_ < text_.size() &&
+               (std::isdigit(static_cast<unsigned char>(text_[pos_])) ||
+                std::string_view("+-.eE").find(text_[pos_]) !=
+                    std::string_view::npos)) {
+            pos_++;
+        }
+        if (begin == pos_) return false;
+        std::string number(text_.substr(begin, pos_ - begin));
+        char* end = nullptr;
+        value.type = JsonValue::Type::Number;
+        value.number = std::strtod(number.c_str(), &end);
+        return end == number.c_str() + number.size();
+    }
+};
+
+inline std::string EscapeJson(std::string_view str) {
+    std::string result;
+    for (char c : str) {
+        if (c == '"' || c == '\\') {
+            result += '\\';
+            result += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char buf[8];
+            std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+            result += buf;
+        } else {
+            result += c;
+        }
+    }
+    return result;
+}
+
+inline std::string EscapeCsv(std::string_view str) {
+    std::string result = "\"";
+    for (char c : str) {
+        if (c == '"') result += '"';
+        result += c;
+    }
+    return result + "\"";
+}
+
+//! @brief write results of groups as JSON, times are in nanoseconds
+inline void WriteJson(std::ostream& o, const std::vector<const Group*>& groups) {
+    auto oldPrecision = o.precision(std::numeric_limits<double>::max_digits10);
+    o << "{\n  \"benchmarks\": [";
+    bool first = true;
+    for (auto group : groups) {
+        for (auto& unit : group->Units()) {
+            for (auto& result : unit.results) {
+                auto& stats = result.stats;
+                o << (first ? "\n" : ",\n") << "    {";
+                first = false;
+                o << "\"group\": \"" << EscapeJson(group->Name()) << "\", "
+                  << "\"name\": \""
+                  << EscapeJson(Group::GetResultName(unit, result)) << "\", "
+                  << "\"unit\": \"" << EscapeJson(unit.name) << "\", "
+                  << "\"arg\": ";
+                if (result.arg) {
+                    o << result.arg.value();
+                } else {
+                    o << "null";
+                }
+                o << ", \"threads\": " << result.threads
+                  << ", \"iterations\": " << stats.iterations
+                  << ", \"samples\": " << stats.samples.size()
+                  << ", \"min\": " << stats.min
+                  << ", \"median\": " << stats.median
+                  << ", \"mean\": " << stats.mean
+                  << ", \"stddev\": " << stats.stddev
+                  << ", \"p90\": " << stats.p90 << ", \"p99\": " << stats.p99
+                  << ", \"max\": " << stats.max;
+                for (size_t i = 0; i < PerfEventCount; i++) {
+                    if (result.perf[i]) {
+                        o << ", \""
+                          << GetPerfEventKey(static_cast<PerfEvent>(i))
+                          << "\": " << result.perf[i].value();
+                    }
+                }
+                if (result.allocations) {
+                    o << ", \"allocations\": " << result.allocations.value()
+                      << ", \"allocated_bytes\": "
+                      << result.allocatedBytes.value();
+                }
+                if (result.bytesProcessed) {
+                    o << ", \"bytes_per_second\": "
+                      << result.Rate(result.bytesProcessed.value());
+                }
+                if (result.itemsProcessed) {
+                    o << ", \"items_per_second\": "
+                      << result.Rate(result.itemsProcessed.value());
+                }
+                if (!result.counters.empty()) {
+                    o << ", \"counters\": {";
+                    const char* separator = "";
+                    for (auto& [name, counter] : result.counters) {
+                        o << separator << "\"" << EscapeJson(name)
+                          << "\": " << result.CounterValue(counter);
+                        separator = ", ";
+                    }
+                    o << "}";
+                }
+                if (result.latency) {
+                    auto& latency = result.latency.value();
+                    o << ", \"latency\": {\"calls\": " << latency.Count()
+                      << ", \"p50\": " << latency.Percentile(0.5)
+                      << ", \"p99\": " << latency.Percentile(0.99)
+                      << ", \"p999\": " << latency.Percentile(0.999)
+                      << ", \"max\": " << latency.Max() << "}";
+                }
+                o << "}";
+            }
+        }
+    }
+    o << "\n  ],\n  \"complexity\": [";
+    first = true;
+    for (auto group : groups) {
+        for (auto& unit : group->Units()) {
+            if (!unit.complexity) continue;
+            o << (first ? "\n" : ",\n") << "    {";
+            first = false;
+            o << "\"group\": \"" << EscapeJson(group->Name()) << "\", "
+              << "\"unit\": \"" << EscapeJson(unit.name) << "\", "
+              << "\"complexity\": \""
+              << GetComplexityName(unit.complexity->complexity) << "\", "
+              << "\"coefficient\": " << unit.complexity->coefficient
+              << ", \"rms\": " << unit.complexity->rms << "}";
+        }
+    }
+    o << "\n  ],\n  \"comparisons\": [";
+    first = true;
+    for (auto group : groups) {
+        for (auto& comparison : group->Comparisons()) {
+            if (!comparison.result) continue;
+            auto& result = comparison.result.value();
+            o << (first ? "\n" : ",\n") << "    {";
+            first = false;
+            o << "\"group\": \"" << EscapeJson(group->Name()) << "\", "
+              << "\"a\": \"" << EscapeJson(comparison.nameA) << "\", "
+              << "\"b\": \"" << EscapeJson(comparison.nameB) << "\", "
+              << "\"cpu\": ";
+            if (result.cpu) {
+                o << result.cpu.value();
+            } else {
+                o << "null";
+            }
+            o << ", \"samples\": " << result.a.samples.size()
+              << ", \"a_median\": " << result.a.median
+              << ", \"b_median\": " << result.b.median
+              << ", \"speedup\": " << result.speedup
+              << ", \"speedup_lower\": " << result.lower
+              << ", \"speedup_upper\": " << result.upper
+              << ", \"warnings\": [";
+            const char* separator = "";
+            for (auto& warning : result.warnings) {
+                o << separator << "\"" << EscapeJson(warning) << "\"";
+                separator = ", ";
+            }
+            o << "]}";
         }
     }
+    o << "\n  ]\n}" << std::endl;
+    o.precision(oldPrecision);
+}
 
-    void measureOneUnitWithExtraOp(Unit& unit) const {
-        if (unit.funcWithOp) {
-            unit.funcWithOp(Measure{unit});
+//! @brief write results of groups as CSV, times are in nanoseconds
+inline void WriteCsv(std::ostream& o, const std::vector<const Group*>& groups) {
+    auto oldPrecision = o.precision(std::numeric_limits<double>::max_digits10);
+    o << "group,name,arg,threads,iterations,samples,min,median,mean,stddev,"
+         "p90,p99,max";
+    for (size_t i = 0; i < PerfEventCount; i++) {
+        o << "," << GetPerfEventKey(static_cast<PerfEvent>(i));
+    }
+    o << ",allocations,allocated_bytes,bytes_per_second,items_per_second,"
+         "latency_p50,latency_p99,latency_p999,latency_max";
+    // a column for every counter name
+    std::vector<std::string> counterNames;
+    for (auto group : groups) {
+        for (auto& unit : group->Units()) {
+            for (auto& result : unit.results) {
+                for (auto& [name, counter] : result.counters) {
+                    if (std::find(counterNames.begin(), counterNames.end(),
+                                  name) == counterNames.end()) {
+                        counterNames.push_back(name);
+                    }
+                }
+            }
+        }
+    }
+    for (auto& name : counterNames) {
+        o << "," << EscapeCsv(name);
+    }
+    o << std::endl;
+    for (auto group : groups) {
+        for (auto& unit : group->Units()) {
+            for (auto& result : unit.results) {
+                auto& stats = result.stats;
+                o << EscapeCsv(group->Name()) << ","
+                  << EscapeCsv(Group::GetResultName(unit, result)) << ",";
+                if (result.arg) {
+                    o << result.arg.value();
+                }
+                o << "," << result.threads << "," << stats.iterations << ","
+                  << stats.samples.size() << "," << stats.min << ","
+                  << stats.median << "," << stats.mean << "," << stats.stddev
+                  << "," << stats.p90 << "," << stats.p99 << "," << stats.max;
+                for (auto& value : result.perf) {
+                    o << ",";
+                    if (value) {
+                        o << value.value();
+                    }
+                }
+                std::optional<double> bytesRate, itemsRate;
+                if (result.bytesProcessed) {
+                    bytesRate = result.Rate(result.bytesProcessed.value());
+                }
+                if (result.itemsProcessed) {
+                    itemsRate = result.Rate(result.itemsProcessed.value());
+                }
+                std::optional<double> p50, p99, p999, max;
+                if (result.latency) {
+                    auto& latency = result.latency.value();
+                    p50 = latency.Percentile(0.5);
+                    p99 = latency.Percentile(0.99);
+                    p999 = latency.Percentile(0.999);
+                    max = latency.Max();
+                }
+                for (auto& value : {result.allocations, result.allocatedBytes,
+                                    bytesRate, itemsRate, p50, p99, p999,
+                                    max}) {
+                    o << ",";
+                    if (value) {
+                        o << value.value();
+                    }
+                }
+                for (auto& name : counterNames) {
+                    o << ",";
+                    auto it = result.counters.find(name);
+                    if (it != result.counters.end()) {
+                        o << result.CounterValue(it->second);
+                    }
+                }
+                o << std::endl;
+            }
         }
     }
+    o.precision(oldPrecision);
+}
+
+//! @brief a result loaded from a JSON report
+struct BaselineResult final {
+    double mean;
+    double stddev;
+    uint64_t samples;
+    std::optional<double> allocations;
 };
 
+//! @brief load results from a JSON report, keyed by group and result name
+inline std::optional<std::map<std::pair<std::string, std::string>, BaselineResult>>
+LoadBaseline(const std::string& filename) {
+    std::ifstream file(filename);
+    if (!file) return std::nullopt;
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    auto json = JsonParser::Parse(buffer.str());
+    if (!json) return std::nullopt;
+    auto benchmarks = json->Find("benchmarks");
+    if (!benchmarks || benchmarks->type != JsonValue::Type::Array) {
+        return std::nullopt;
+    }
+
+    std::map<std::pair<std::string, std::string>, BaselineResult> baseline;
+    for (auto& entry : benchmarks->array) {
+        auto group = entry.Find("group");
+        auto name = entry.Find("name");
+        auto mean = entry.Find("mean");
+        auto stddev = entry.Find("stddev");
+        auto samples = entry.Find("samples");
+        if (!group || !name || !mean || !stddev || !samples) continue;
+        auto& result = baseline[{group->string, name->string}];
+        result = BaselineResult{mean->number, stddev->number,
+                                static_cast<uint64_t>(samples->number),
+                                std::nullopt};
+        if (auto allocations = entry.Find("allocations")) {
+            result.allocations = allocations->number;
+        }
+    }
+    return baseline;
+}
+
 class BenchmarkMgr final {
  public:
     static BenchmarkMgr& Instance() {
@@ -124,18 +2188,122 @@ class BenchmarkMgr final {
         }
     }
 
-    void RunByCmd(int argc, char** argv) {
-        if (argc == 1) {
-            RunAll();
+    //! @brief run groups named in cmdline(all groups if no name), options:
+    //!   --format=console|json|csv  report format, default is console
+    //!   --out=file                 write report into file instead of stdout
+    //!   --baseline=file.json       compare with a JSON report
+    //!   --threshold=0.05           min relative slowdown to be a regression,
+    //!                              must be positive
+    //!   --perf                     collect hardware counters(Linux only)
+    //!   --cpu=N                    pin comparisons to cpu N(Linux only)
+    //! @return 0 if succeed, 1 if regression found, 2 if cmdline/baseline is
+    //! invalid
+    int RunByCmd(int argc, char** argv) {
+        std::string format = "console", out, baselineFile;
+        double threshold = 0.05;
+        std::vector<std::string> names;
+        for (int i = 1; i < argc; i++) {
+            std::string_view arg = argv[i];
+            if (arg.substr(0, 2) != "--") {
+                names.emplace_back(arg);
+            } else if (arg.substr(0, 9) == "--format=") {
+                format = arg.substr(9);
+            } else if (arg.substr(0, 6) == "--out=") {
+                out = arg.substr(6);
+            } else if (arg.substr(0, 11) == "--baseline=") {
+                baselineFile = arg.substr(11);
+            } else if (arg.substr(0, 12) == "--threshold=") {
+                std::string value(arg.substr(12));
+                char* end = nullptr;
+                threshold = std::strtod(value.c_str(), &end);
+                if (value.empty() || end != value.c_str() + value.size() ||
+                    !(threshold > 0) || !std::isfinite(threshold)) {
+                    std::cerr << "invalid threshold " << value << std::endl;
+                    return 2;
+                }
+            } else if (arg == "--perf") {
+                PerfCountersEnabled() = true;
+            } else if (arg.substr(0, 6) == "--cpu=") {
+                ComparisonCpu() = std::atoi(std::string(arg.substr(6)).c_str());
+            } else {
+                std::cerr << "unknown option " << arg << std::endl;
+                return 2;
+            }
+        }
+        if (format != "console" && format != "json" && format != "csv") {
+            std::cerr << "unknown format " << format << std::endl;
+            return 2;
+        }
+
+        std::optional<std::map<std::pair<std::string, std::string>,
+                               BaselineResult>>
+            baseline;
+        if (!baselineFile.empty()) {
+            baseline = LoadBaseline(baselineFile);
+            if (!baseline) {
+                std::cerr << "can't load baseline " << baselineFile << std::endl;
+                return 2;
+            }
+        }
+
+        // keep stdout clean for machine readable report
+        std::ostream& log =
+            (format != "console" && out.empty()) ? std::cerr : std::cout;
+
+        if (PerfCountersEnabled() && !PerfCounters().Available()) {
+            log << "hardware counters are unavailable(Linux only, check "
+                   "/proc/sys/kernel/perf_event_paranoid), measure time only"
+                << std::endl;
+        }
+
+        std::vector<const Group*> groups;
+        auto runGroup = [&](Group& group) {
+            group.DoBenchmark(log);
+            log << std::endl;
+            group.ShowResult(log);
+            log << "--------------------------------" << std::endl;
+            groups.push_back(&group);
+        };
+        if (names.empty()) {
+            for (auto& [name, group] : groups_) {
+                runGroup(group);
+            }
         } else {
-            for (int i = 1; i < argc; i++) {
-                auto it = groups_.find(argv[i]);
+            for (auto& name : names) {
+                auto it = groups_.find(name);
                 if (it != groups_.end()) {
-                    doBenchmarkInGroup(it->second);
-                    drawGroupSplitLine();
+                    runGroup(it->second);
+                }
+            }
+        }
+
+        if (format != "console" || !out.empty()) {
+            std::ofstream file;
+            if (!out.empty()) {
+                file.open(out);
+                if (!file) {
+                    std::cerr << "can't open " << out << std::endl;
+                    return 2;
+                }
+            }
+            std::ostream& o = out.empty() ? std::cout : file;
+            if (format == "json") {
+                WriteJson(o, groups);
+            } else if (format == "csv") {
+                WriteCsv(o, groups);
+            } else {
+                for (auto group : groups) {
+                    group->ShowResult(o);
                 }
             }
         }
+
+        if (baseline) {
+            return compareWithBaseline(log, groups, baseline.value(), threshold)
+                       ? 0
+                       : 1;
+        }
+        return 0;
     }
 
     template <typename... Names>
@@ -147,14 +2315,34 @@ class BenchmarkMgr final {
 
     void PushCurrentGroup() {
         if (group_) {
-            groups_.emplace(group_->name_, group_.value());
+            auto it = groups_.emplace(group_->name_, Group(group_->name_)).first;
+            for (auto& unit : group_->units_) {
+                it->second.Add(unit);
+            }
+            for (auto& comparison : group_->comparisons_) {
+                it->second.Add(comparison);
+            }
+            group_ = std::nullopt;
         }
     }
 
-    void AddUnit2CurrentGroup(const Unit& unit) {
-        if (group_) {
-            group_->Add(unit);
+    //! @brief add unit into current group("default" if no group began),
+    //! returned unit can be configured(eg: `Range`) in place
+    Unit& AddUnit2CurrentGroup(const Unit& unit) {
+        if (!group_) {
+            BeginGroup("default");
+        }
+        group_->Add(unit);
+        return group_->units_.back();
+    }
+
+    //! @brief add comparison into current group("default" if no group began)
+    Comparison& AddComparison2CurrentGroup(const Comparison& comparison) {
+        if (!group_) {
+            BeginGroup("default");
         }
+        group_->Add(comparison);
+        return group_->comparisons_.back();
     }
 
  private:
@@ -194,23 +2382,227 @@ class BenchmarkMgr final {
     void drawGroupSplitLine() {
         std::cout << "--------------------------------" << std::endl;
     }
+
+    //! @brief print comparison, mean time changed more than threshold with
+    //! p-value < 0.05 is significant
+    //! @return false if any regression found
+    static bool compareWithBaseline(
+        std::ostream& o, const std::vector<const Group*>& groups,
+        const std::map<std::pair<std::string, std::string>, BaselineResult>&
+            baseline,
+        double threshold) {
+        constexpr double alpha = 0.05;
+        bool passed = true;
+        o << "compare with baseline(threshold " << threshold * 100
+          << "%):" << std::endl;
+        for (auto group : groups) {
+            for (auto& unit : group->Units()) {
+                for (auto& result : unit.results) {
+                    auto name = Group::GetResultName(unit, result);
+                    o << group->Name() << "/" << name << ": ";
+                    auto it = baseline.find({std::string(group->Name()), name});
+                    if (it == baseline.end()) {
+                        o << "not in baseline" << std::endl;
+                        continue;
+                    }
+                    auto& base = it->second;
+                    auto& stats = result.stats;
+                    double change =
+                        base.mean == 0 ? 0 : (stats.mean - base.mean) / base.mean;
+                    double p = WelchTTest(stats.mean, stats.stddev,
+                                          stats.samples.size(), base.mean,
+                                          base.stddev, base.samples);
+                    o << FormatTime(base.mean) << " -> " << FormatTime(stats.mean)
+                      << "(" << std::showpos << std::fixed
+                      << std::setprecision(1) << change * 100 << "%"
+                      << std::noshowpos << ", p=" << std::setprecision(4) << p
+                      << std::defaultfloat << std::setprecision(6) << ")";
+                    if (p < alpha && change > threshold) {
+                        o << "\tREGRESSION";
+                        passed = false;
+                    } else if (p < alpha && change < -threshold) {
+                        o << "\timproved";
+                    }
+                    // allocations are almost deterministic, more than half
+                    // an allocation per iteration is a regression
+                    if (base.allocations && result.allocations &&
+                        result.allocations.value() - base.allocations.value() >
+                            std::max(base.allocations.value() * threshold,
+                                     0.5)) {
+                        o << "\tALLOCATION REGRESSION("
+                          << base.allocations.value() << " -> "
+                          << result.allocations.value() << ")";
+                        passed = false;
+                    }
+                    o << std::endl;
+                }
+            }
+        }
+        return passed;
+    }
 };
 
 }  // namespace benchmark
 
+// replace global operator new/delete to count allocations, define
+// BENCHMARK_TRACK_ALLOCATIONS in only one translation unit
+#ifdef BENCHMARK_TRACK_ALLOCATIONS
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+// hooks must not be inlined into the operators: GCC(-Wmismatched-new-delete)
+// would see `std::free` called on memory from operator new, which is right
+// here because our operator new allocates by `std::malloc`
+#ifdef _MSC_VER
+#define BENCHMARK_NOINLINE __declspec(noinline)
+#else
+#define BENCHMARK_NOINLINE __attribute__((noinline))
+#endif
+
+namespace benchmark {
+namespace internal {
+
+BENCHMARK_NOINLINE inline void* TrackedAlloc(std::size_t size, std::size_t alignment) {
+    if (!allocationPaused) {
+        allocationCount.fetch_add(1, std::memory_order_relaxed);
+        allocationBytes.fetch_add(size, std::memory_order_relaxed);
+    }
+    if (size == 0) {
+        size = 1;
+    }
+    while (true) {
+        void* ptr;
+        if (alignment <= alignof(std::max_align_t)) {
+            ptr = std::malloc(size);
+        } else {
+#ifdef _MSC_VER
+            ptr = _aligned_malloc(size, alignment);
+#else
+            // size must be a multiple of alignment
+            ptr = std::aligned_alloc(
+                alignment, (size + alignment - 1) / alignment * alignment);
+#endif
+        }
+        if (ptr) {
+            return ptr;
+        }
+        auto handler = std::get_new_handler();
+        if (!handler) {
+            throw std::bad_alloc();
+        }
+        handler();
+    }
+}
+
+BENCHMARK_NOINLINE inline void TrackedFree(void* ptr, std::size_t alignment) {
+#ifdef _MSC_VER
+    if (alignment > alignof(std::max_align_t)) {
+        _aligned_free(ptr);
+        return;
+    }
+#else
+    (void)alignment;
+#endif
+    std::free(ptr);
+}
+
+// set before main, so only units in a tracking program report allocations
+[[maybe_unused]] static const bool allocationTrackingEnabled =
+    (allocationTracking = true, true);
+
+}  // namespace internal
+}  // namespace benchmark
+
+void* operator new(std::size_t size) {
+    return benchmark::internal::TrackedAlloc(size, 0);
+}
+
+void* operator new[](std::size_t size) {
+    return benchmark::internal::TrackedAlloc(size, 0);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    return benchmark::internal::TrackedAlloc(
+        size, static_cast<std::size_t>(alignment));
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment) {
+    return benchmark::internal::TrackedAlloc(
+        size, static_cast<std::size_t>(alignment));
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    try {
+        return benchmark::internal::TrackedAlloc(size, 0);
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    try {
+        return benchmark::internal::TrackedAlloc(size, 0);
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void operator delete(void* ptr) noexcept {
+    benchmark::internal::TrackedFree(ptr, 0);
+}
+
+void operator delete[](void* ptr) noexcept {
+    benchmark::internal::TrackedFree(ptr, 0);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept {
+    benchmark::internal::TrackedFree(ptr, 0);
+}
+
+void operator delete[](void* ptr, std::size_t) noexcept {
+    benchmark::internal::TrackedFree(ptr, 0);
+}
+
+void operator delete(void* ptr, std::align_val_t alignment) noexcept {
+    benchmark::internal::TrackedFree(ptr, static_cast<std::size_t>(alignment));
+}
+
+void operator delete[](void* ptr, std::align_val_t alignment) noexcept {
+    benchmark::internal::TrackedFree(ptr, static_cast<std::size_t>(alignment));
+}
+
+void operator delete(void* ptr, std::size_t,
+                     std::align_val_t alignment) noexcept {
+    benchmark::internal::TrackedFree(ptr, static_cast<std::size_t>(alignment));
+}
+
+void operator delete[](void* ptr, std::size_t,
+                       std::align_val_t alignment) noexcept {
+    benchmark::internal::TrackedFree(ptr, static_cast<std::size_t>(alignment));
+}
+#endif
+
 #define BENCHMARK_MAIN int main(int argc, char** argv)
 #define BENCHMARK_GROUP(name)                               \
     benchmark::BenchmarkMgr::Instance().PushCurrentGroup(); \
     benchmark::BenchmarkMgr::Instance().BeginGroup(name);
+// unit options can follow: BENCHMARK_ADD(name, func).Range(1 << 10, 1 << 20);
 #define BENCHMARK_ADD(name, func)                             \
     benchmark::BenchmarkMgr::Instance().AddUnit2CurrentGroup( \
-        benchmark::Unit(name, func));
+        benchmark::Unit(name, func))
+// run functions a and b alternately and report speedup of b over a:
+// BENCHMARK_COMPARE(OldSort, NewSort).Cpu(2);
+#define BENCHMARK_COMPARE(a, b)                                     \
+    benchmark::BenchmarkMgr::Instance().AddComparison2CurrentGroup( \
+        benchmark::Comparison(#a, a, #b, b))
 #define BENCHMARK_RUN_GROUPS(...)                           \
     benchmark::BenchmarkMgr::Instance().PushCurrentGroup(); \
     benchmark::BenchmarkMgr::Instance().Run(__VA_ARGS__);
 #define BENCHMARK_RUN_ALL()                                 \
     benchmark::BenchmarkMgr::Instance().PushCurrentGroup(); \
     benchmark::BenchmarkMgr::Instance().RunAll();
+// returns from main with the exit code of RunByCmd
 #define BENCHMARK_RUN()                                     \
     benchmark::BenchmarkMgr::Instance().PushCurrentGroup(); \
-    benchmark::BenchmarkMgr::Instance().RunByCmd(argc, argv);
+    return benchmark::BenchmarkMgr::Instance().RunByCmd(argc, argv);
@@ -1,6 +1,14 @@
-#define BENCHMARK_REPEAT_NUM 1
+// collect at most 3 samples, iterations of a sample are calibrated
+// automatically(define BENCHMARK_REPEAT_NUM to use a fixed count)
+#define BENCHMARK_SAMPLE_NUM 3
+// count heap allocations of every unit, define it in only one source file
+#define BENCHMARK_TRACK_ALLOCATIONS
 #include "benchmark.hpp"
+#include <atomic>
+#include <memory>
+#include <numeric>
 #include <thread>
+#include <vector>
 
 void Delay2s() {
     std::this_thread::sleep_for(std::chrono::seconds(2));
@@ -18,6 +26,94 @@ void use_measure(benchmark::Measure measure) {
     // some end
 }
 
+void use_do_not_optimize(benchmark::Measure measure) {
+    std::vector<int> v;
+    v.reserve(1);
+    measure([&]{
+        // returned value is consumed automatically, others need DoNotOptimize
+        benchmark::DoNotOptimize(v.data());
+        v.push_back(42);
+        // make sure 42 is written to memory
+        benchmark::ClobberMemory();
+        v.pop_back();
+    });
+}
+
+void use_range(benchmark::Measure measure) {
+    // run with every argument in range, then complexity is fitted
+    std::vector<int64_t> v(measure.Arg(), 1);
+    measure([&]{
+        return std::accumulate(v.begin(), v.end(), int64_t(0));
+    });
+    // report GB/s, items/s and time of one item
+    measure.SetBytesProcessed(v.size() * sizeof(int64_t));
+    measure.SetItemsProcessed(v.size());
+    // custom counters, rate counters are shown per second
+    measure.SetCounter("vectors", 1);
+    measure.SetCounter("adds", v.size() - 1, benchmark::CounterType::Rate);
+}
+
+std::atomic<int64_t> shared_counter;
+
+void use_threads(benchmark::Measure measure) {
+    // called on every thread, measure.ThreadIndex() tells which one
+    measure([]{
+        return shared_counter.fetch_add(1, std::memory_order_relaxed);
+    });
+}
+
+void use_allocation(benchmark::Measure measure) {
+    // allocations and allocated bytes per iteration are reported
+    measure([]{
+        return std::make_unique<int64_t>(42);
+    });
+}
+
+std::vector<int> fixture_data;
+
+void use_fixture(benchmark::Measure measure) {
+    measure([&]{
+        // rebuild state of every iteration out of timing
+        measure.PauseTiming();
+        fixture_data.assign(1000, 1);
+        measure.ResumeTiming();
+        fixture_data.clear();
+    });
+}
+
+std::vector<int> frame_data(1000, 1);
+
+void use_latency(benchmark::Measure measure) {
+    int frame = 0;
+    measure([&]{
+        // most frames are cheap, every 100th frame does heavy work, it only
+        // shows in the tail of call time
+        int passes = ++frame % 100 == 0 ? 50 : 1;
+        int64_t sum = 0;
+        for (int i = 0; i < passes; i++) {
+            benchmark::DoNotOptimize(frame_data.data());
+            sum += std::accumulate(frame_data.begin(), frame_data.end(), int64_t(0));
+        }
+        return sum;
+    });
+}
+
+std::vector<int> compare_data(4096, 1);
+
+int64_t sum_by_index() {
+    int64_t sum = 0;
+    benchmark::DoNotOptimize(compare_data.data());
+    for (size_t i = 0; i < compare_data.size(); i++) {
+        sum += compare_data[i];
+    }
+    return sum;
+}
+
+int64_t sum_by_accumulate() {
+    benchmark::DoNotOptimize(compare_data.data());
+    return std::accumulate(compare_data.begin(), compare_data.end(), int64_t(0));
+}
+
 BENCHMARK_MAIN {
     BENCHMARK_GROUP("group1") {
         BENCHMARK_ADD("Delay1s", Delay1s);
@@ -25,6 +121,32 @@ BENCHMARK_MAIN {
     }
     BENCHMARK_GROUP("group2") {
         BENCHMARK_ADD("use_measure", use_measure);
+        BENCHMARK_ADD("use_do_not_optimize", use_do_not_optimize);
+    }
+    BENCHMARK_GROUP("group3") {
+        BENCHMARK_ADD("use_range", use_range).Range(1 << 10, 1 << 16, 4);
+    }
+    BENCHMARK_GROUP("group4") {
+        // run on 1, 2 and 4 threads
+        BENCHMARK_ADD("use_threads", use_threads).Threads(2).Threads(4);
+    }
+    BENCHMARK_GROUP("group5") {
+        BENCHMARK_ADD("use_allocation", use_allocation);
+    }
+    BENCHMARK_GROUP("group6") {
+        // setup and teardown run before and after measuring, out of timing
+        BENCHMARK_ADD("use_fixture", use_fixture)
+            .Setup([](const benchmark::Measure&) { fixture_data.reserve(1000); })
+            .Teardown([](const benchmark::Measure&) { fixture_data.shrink_to_fit(); });
+    }
+    BENCHMARK_GROUP("group7") {
+        // time every call, report p50, p99, p99.9 and max of call time
+        BENCHMARK_ADD("use_latency", use_latency).Latency();
+    }
+    BENCHMARK_GROUP("group8") {
+        // run two implementations alternately on one cpu, report speedup of
+        // the second with 95% confidence interval
+        BENCHMARK_COMPARE(sum_by_index, sum_by_accumulate);
     }
 
     /*
@@ -38,6 +160,17 @@ BENCHMARK_MAIN {
     /*
         run groups, you can send group names in cmdline. Eg:
         ./benchmark group1
+        save a JSON report and compare later runs with it, exit code is 1
+        if any unit is slower than baseline by 5% with statistical
+        significance:
+        ./benchmark --format=json --out=base.json
+        ./benchmark --baseline=base.json --threshold=0.05
+        --format=csv is also supported
+        collect cycles, instructions, cache and branch misses per iteration
+        (Linux only):
+        ./benchmark --perf
+        pin comparisons to cpu 2(Linux only):
+        ./benchmark group8 --cpu=2
     */
     BENCHMARK_RUN();
 }
\ No newline at end of file
@@ -4,7 +4,6 @@
 #define CGMATH_NUMERIC_TYPE double
 #include "cgmath.hpp"
 
-#define BENCHMARK_REPEAT_NUM 10000000
 #include "benchmark.hpp"
 
 void SimpleAdd(benchmark::Measure measure) {
@@ -12,7 +11,9 @@ void SimpleAdd(benchmark::Measure measure) {
     cgmath::Vec4 vec2{5, 6, 7, 8};
 
     measure([&](){
-        auto v = vec1 + vec2;
+        benchmark::DoNotOptimize(vec1);
+        benchmark::DoNotOptimize(vec2);
+        return vec1 + vec2;
     });
 }
 
@@ -21,7 +22,9 @@ void SimpleDot(benchmark::Measure measure) {
     cgmath::Vec4 vec2{5, 6, 7, 8};
 
     measure([&](){
-        auto v = vec1.Dot(vec2);
+        benchmark::DoNotOptimize(vec1);
+        benchmark::DoNotOptimize(vec2);
+        return vec1.Dot(vec2);
     });
 }
 
@@ -16,6 +16,11 @@ struct Timer {
     int t;
 };
 
+template <int N>
+struct Tag {
+    int value = N;
+};
+
 void StartUpSystem(Commands& command, Resources) {
     command.Spawn<Name>(Name{ "person1" })
            .Spawn<Name, ID>(Name{"person2"}, ID{1})
@@ -90,6 +95,70 @@ int main() {
     std::cout << "==================" << std::endl;
     world.Update();
 
+    // move a hierarchy into another world
+    World other;
+    Commands commands(world);
+    Entity parent = commands.SpawnImmediateAndReturn<Node, Name>(Node{}, Name{"parent"});
+    Entity child = commands.SpawnImmediateAndReturn<Node, Name>(Node{}, Name{"child"});
+    commands.ChangeHierarchy(parent).Append({child});
+    commands.Execute();
+
+    auto remap = world.MoveEntities(other, {parent});
+    assert(remap.size() == 2);
+    assert(!Querier{world}.Alive(parent) && !Querier{world}.Alive(child));
+    Querier otherQuerier{other};
+    assert(otherQuerier.Get<Name>(remap[child]).name == "child");
+    assert(otherQuerier.Get<Node>(remap[child]).parent == remap[parent]);
+
+    // a dangling child id is dropped, not mapped to another entity
+    Entity root = commands.SpawnImmediateAndReturn<Node, Name>(Node{}, Name{"root"});
+    Entity leaf = commands.SpawnImmediateAndReturn<Node, Name>(Node{}, Name{"leaf"});
+    Entity stale = commands.SpawnImmediateAndReturn<Name>(Name{"stale"});
+    commands.ChangeHierarchy(root).Append({leaf});
+    commands.Execute();
+    Querier{world}.Get<Node>(root).children.push_back(stale);
+    commands.DestroyEntity(stale);
+    commands.Execute();
+
+    auto treeRemap = world.MoveEntities(other, {root});
+    assert(treeRemap.size() == 2);
+    assert(!treeRemap.count(stale));
+    auto& rootChildren = otherQuerier.Get<Node>(treeRemap.at(root)).children;
+    assert(rootChildren.size() == 1 && rootChildren[0] == treeRemap.at(leaf));
+
+    auto usage = other.MemoryStats().Total();
+    std::cout << "other world memory: " << usage.used << "/" << usage.reserved << " bytes" << std::endl;
+    // command list of last `Update` keeps its capacity until `Trim`
+    assert(world.MemoryStats().commandBuffers.reserved >= sizeof(Commands));
+    assert(world.MemoryStats().commandBuffers.used == 0);
+    world.Trim();
+    assert(world.MemoryStats().commandBuffers.reserved == 0);
+
+    // type IDs are stable hashes of type names
+    static_assert(TypeID<Name>() != TypeID<ID>());
+    // types with the same name(lambdas on GCC) still get different IDs
+    auto lambda1 = []() {};
+    auto lambda2 = []() {};
+    assert(IndexGetter::Get<decltype(lambda1)>() != IndexGetter::Get<decltype(lambda2)>());
+    assert(IndexGetter::Get<decltype(lambda1)>() == IndexGetter::Get<decltype(lambda1)>());
+    assert(IndexGetter::Get<Name>() == TypeID<Name>());
+
+    // component infos are found by a perfect hash rebuilt for every new type
+    World tags;
+    Commands tagCommands(tags);
+    Entity tagged = tagCommands.SpawnImmediateAndReturn(
+        Tag<0>{}, Tag<1>{}, Tag<2>{}, Tag<3>{}, Tag<4>{}, Tag<5>{}, Tag<6>{},
+        Tag<7>{}, Tag<8>{});
+    assert(tags.MemoryStats().components.size() == 9);
+    assert(Querier{tags}.Get<Tag<5>>(tagged).value == 5);
+    tagCommands.DestroyEntity(tagged);
+    tagCommands.Execute();
+    for (auto& [_, componentUsage] : tags.MemoryStats().components) {
+        assert(componentUsage.used == 0);
+    }
+    tags.Shutdown();
+
     world.Shutdown();
+    other.Shutdown();
     return 0;
 }
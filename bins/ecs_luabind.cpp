@@ -0,0 +1,174 @@
+#include "ecs_luabind.hpp"
+
+#define CATCH_CONFIG_MAIN
+#include "3rdlibs/catch.hpp"
+
+struct Position {
+    float x, y;
+};
+
+struct Velocity {
+    float x, y;
+};
+
+struct FrameCount {
+    int count;
+};
+
+void SpawnSystem(ecs::Commands& cmds, ecs::Resources) {
+    for (int i = 0; i < 10; i++) {
+        cmds.Spawn<Position, Velocity>(Position{0, 0}, Velocity{1, float(i)});
+    }
+    cmds.Spawn<Position>(Position{100, 100});
+}
+
+TEST_CASE("lua systems", "[ecs_luabind]") {
+    sol::state lua;
+    lua.open_libraries(sol::lib::base);
+    lua.new_usertype<Position>("Position", "x", &Position::x, "y", &Position::y);
+    lua.new_usertype<Velocity>("Velocity", "x", &Velocity::x, "y", &Velocity::y);
+    lua.new_usertype<FrameCount>("FrameCount", "count", &FrameCount::count);
+
+    lua_bind::LuaECS luaEcs(lua);
+    luaEcs.BindComponent<Position>("Position")
+          .BindComponent<Velocity>("Velocity")
+          .BindResource<FrameCount>("FrameCount")
+          .BindEvent<std::string>("Message");
+
+    lua.script(R"(
+        local batch = {}
+        moved = 0
+        message = nil
+        ecs.AddSystem(function(cmds, querier, res, events)
+            local n = querier:Fill(batch, "Position", "Velocity")
+            for i = 1, n do
+                local p, v = batch.Position[i], batch.Velocity[i]
+                p.x = p.x + v.x
+                p.y = p.y + v.y
+            end
+            moved = moved + n
+            res:Get("FrameCount").count = res:Get("FrameCount").count + 1
+            if events:Has("Message") then
+                message = events:Read("Message")
+            end
+            events:Write("Message", "hello")
+        end)
+    )");
+
+    ecs::World world;
+    world.AddStartupSystem(SpawnSystem)
+         .SetResource<FrameCount>(FrameCount{0})
+         .SetResource<lua_bind::LuaECS*>(&luaEcs)
+         .AddSystem(lua_bind::LuaSystemsRunner);
+    world.Startup();
+
+    world.Update();
+    world.Update();
+
+    REQUIRE(lua["moved"].get<int>() == 20);
+    REQUIRE(world.GetResource<FrameCount>()->count == 2);
+    REQUIRE(lua["message"].get<std::string>() == "hello");
+
+    ecs::Querier querier(world);
+    auto entities = querier.Query<ecs::With<Position, Velocity>>();
+    REQUIRE(entities.size() == 10);
+    for (auto entity : entities) {
+        REQUIRE(querier.Get<Position>(entity).x == 2);
+        REQUIRE(querier.Get<Position>(entity).y == querier.Get<Velocity>(entity).y * 2);
+    }
+
+    world.Shutdown();
+}
+
+TEST_CASE("fill clears stale entities", "[ecs_luabind]") {
+    sol::state lua;
+    lua.open_libraries(sol::lib::base);
+    lua.new_usertype<Position>("Position", "x", &Position::x, "y", &Position::y);
+
+    lua_bind::LuaECS luaEcs(lua);
+    luaEcs.BindComponent<Position>("Position");
+
+    lua.script(R"(
+        batch = {}
+        counts = {}
+        ecs.AddSystem(function(cmds, querier, res, events)
+            local n = querier:Fill(batch, "Position")
+            local iterated = 0
+            for _ in ipairs(batch.Position) do
+                iterated = iterated + 1
+            end
+            counts[#counts + 1] = {n, #batch.entities, #batch.Position, iterated}
+            if n > 0 then
+                cmds:DestroyEntity(batch.entities[n])
+            end
+        end)
+    )");
+
+    ecs::World world;
+    world.SetResource<lua_bind::LuaECS*>(&luaEcs)
+         .AddSystem(lua_bind::LuaSystemsRunner);
+    world.Startup();
+    ecs::Commands commands(world);
+    for (int i = 0; i < 3; i++) {
+        commands.Spawn<Position>(Position{float(i), 0});
+    }
+    commands.Execute();
+
+    // every frame destroys one entity, so the query shrinks
+    for (int frame = 0; frame < 4; frame++) {
+        world.Update();
+    }
+    sol::table counts = lua["counts"];
+    REQUIRE(counts.size() == 4);
+    for (int frame = 0; frame < 4; frame++) {
+        int expected = 3 - frame;
+        sol::table count = counts[frame + 1];
+        for (int i = 1; i <= 4; i++) {
+            REQUIRE(count[i].get<int>() == expected);
+        }
+    }
+    sol::table entities = lua["batch"]["entities"];
+    REQUIRE(!entities.raw_get<sol::optional<ecs::Entity>>(1));
+
+    world.Shutdown();
+}
+
+TEST_CASE("lua commands", "[ecs_luabind]") {
+    sol::state lua;
+    lua.open_libraries(sol::lib::base);
+    lua.new_usertype<Position>("Position", sol::constructors<Position()>(), "x", &Position::x, "y", &Position::y);
+
+    lua_bind::LuaECS luaEcs(lua);
+    luaEcs.BindComponent<Position>("Position");
+
+    lua.script(R"(
+        ecs.AddSystem(function(cmds, querier, res, events)
+            local entities = querier:Query("Position")
+            if #entities == 0 then
+                local p = Position.new()
+                p.x = 3
+                spawned = cmds:Spawn({Position = p})
+            else
+                found = #entities
+                x = querier:Get(entities[1], "Position").x
+                cmds:DestroyEntity(entities[1])
+            end
+        end)
+    )");
+
+    ecs::World world;
+    world.SetResource<lua_bind::LuaECS*>(&luaEcs)
+         .AddSystem(lua_bind::LuaSystemsRunner);
+    world.Startup();
+
+    world.Update();
+    auto entity = lua["spawned"].get<ecs::Entity>();
+    REQUIRE(ecs::Querier(world).Alive(entity));
+
+    world.Update();
+    REQUIRE(lua["found"].get<int>() == 1);
+    REQUIRE(lua["x"].get<float>() == 3);
+    REQUIRE(!ecs::Querier(world).Alive(entity));
+
+    world.Shutdown();
+}
@@ -0,0 +1,150 @@
+// a headless game loop: movement, tween and hierarchy systems run by
+// ecs::World::Update, report frame time for different entity counts
+//
+// usage: sim_benchmark [frames] [entity counts...]
+#include <chrono>
+#include <climits>
+#include <cstdlib>
+#include <iostream>
+#include <optional>
+#include <vector>
+
+#include "cgmath.hpp"
+#include "ecs.hpp"
+#include "tweeny.hpp"
+
+using namespace ecs;
+
+constexpr float DeltaTime = 1.0f / 60.0f;
+constexpr int NodesPerTree = 8;
+
+struct Velocity {
+    cgmath::Vec3 value;
+};
+
+struct WorldTransform {
+    cgmath::Mat44 mat = cgmath::Mat44::Identity();
+};
+
+void MovementSystem(Commands&, Querier querier, Resources, Events&) {
+    for (auto entity : querier.Query<With<cgmath::SRT, Velocity>>()) {
+        querier.Get<cgmath::SRT>(entity).position +=
+            querier.Get<Velocity>(entity).value * DeltaTime;
+    }
+}
+
+void TweenSystem(Commands&, Querier querier, Resources, Events&) {
+    for (auto entity : querier.Query<With<cgmath::SRT, tweeny::Tween<float>>>()) {
+        auto& tween = querier.Get<tweeny::Tween<float>>(entity);
+        tween.Step(DeltaTime);
+        auto value = tween.CurValue();
+        querier.Get<cgmath::SRT>(entity).scale = cgmath::Vec3{value, value, value};
+    }
+}
+
+void TransformSystem(std::optional<Entity> parent, Entity entity, Commands&,
+                     Querier querier, Resources, Events&) {
+    auto mat = querier.Get<cgmath::SRT>(entity).Mat();
+    if (parent) {
+        mat = querier.Get<WorldTransform>(parent.value()).mat * mat;
+    }
+    querier.Get<WorldTransform>(entity).mat = mat;
+}
+
+void Spawn(World& world, int count) {
+    Commands commands(world);
+    auto tween = tweeny::Tween<float>::From(1).To(2).During(1).Loop(-1);
+    std::vector<Entity> children;
+    for (int i = 0; i < count; i += NodesPerTree) {
+        children.clear();
+        std::optional<Entity> root;
+        for (int j = 0; j < NodesPerTree && i + j < count; j++) {
+            float f = static_cast<float>(i + j);
+            auto entity = commands.SpawnImmediateAndReturn<cgmath::SRT, Velocity, tweeny::Tween<float>, Node, WorldTransform>(
+                cgmath::SRT{cgmath::Vec3{f, f, 0}, cgmath::Vec3{1, 1, 1}, cgmath::Vec3{}},
+                Velocity{cgmath::Vec3{1, 0.5, 0}},
+                tweeny::Tween<float>(tween),
+                Node{},
+                WorldTransform{});
+            if (!root) {
+                root = entity;
+            } else {
+                children.push_back(entity);
+            }
+        }
+        commands.ChangeHierarchy(root.value()).Append(children);
+    }
+    commands.Execute();
+}
+
+void Run(int count, int frames) {
+    World world;
+    world.AddSystem(MovementSystem)
+         .AddSystem(TweenSystem)
+         .AddSystem(TransformSystem);
+    Spawn(world, count);
+
+    // warmup
+    world.Update();
+
+    auto begin = std::chrono::steady_clock::now();
+    for (int i = 0; i < frames; i++) {
+        world.Update();
+    }
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                  std::chrono::steady_clock::now() - begin)
+                  .count();
+
+    double frameNs = static_cast<double>(ns) / frames;
+    std::cout << "entities: " << count
+              << "\tframes: " << frames
+              << "\tfps: " << 1e9 / frameNs
+              << "\tns/entity/frame: " << frameNs / count << std::endl;
+
+    world.Shutdown();
+}
+
+//! @brief parse a positive integer, std::nullopt if arg isn't one
+std::optional<int> ParsePositive(const char* arg) {
+    char* end = nullptr;
+    long value = std::strtol(arg, &end, 10);
+    if (end == arg || *end != '\0' || value <= 0 || value > INT_MAX) {
+        return std::nullopt;
+    }
+    return static_cast<int>(value);
+}
+
+int Usage(const char* program) {
+    std::cerr << "usage: " << program << " [frames] [entity counts...]"
+              << std::endl
+              << "frames and entity counts must be positive integers"
+              << std::endl;
+    return 1;
+}
+
+int main(int argc, char** argv) {
+    int frames = 60;
+    if (argc > 1) {
+        auto value = ParsePositive(argv[1]);
+        if (!value) {
+            return Usage(argv[0]);
+        }
+        frames = value.value();
+    }
+    std::vector<int> counts;
+    for (int i = 2; i < argc; i++) {
+        auto value = ParsePositive(argv[i]);
+        if (!value) {
+            return Usage(argv[0]);
+        }
+        counts.push_back(value.value());
+    }
+    if (counts.empty()) {
+        counts = {1000, 10000, 50000};
+    }
+
+    for (auto count : counts) {
+        Run(count, frames);
+    }
+    return 0;
+}
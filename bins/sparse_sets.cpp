@@ -1,4 +1,16 @@
 #include "sparse_sets.hpp"
+#include "sparse_sets_image.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <numeric>
+#include <set>
+#include <thread>
+#include <vector>
 
 int main() {
     SparseSets<uint32_t, 10> set;
@@ -27,4 +39,240 @@ int main() {
 
     set.Remove(13);
     assert(!set.Contain(13));
+
+    // pages are allocated on demand and released when empty
+    SparseSets<uint32_t, 32> sparse;
+    sparse.Add(10000000);
+    sparse.Add(10000001);
+    assert(sparse.PageCount() == 1);
+    assert(!sparse.Contain(5));
+    sparse.Remove(10000000);
+    sparse.Remove(10000001);
+    assert(sparse.PageCount() == 0);
+    assert(!sparse.Contain(10000000));
+    sparse.ShrinkToFit();
+    assert(sparse.MemoryUsage() == 0);
+
+    // set algebra
+    SparseSets<uint32_t, 10> a, b, c;
+    for (uint32_t i = 0; i < 30; i++) {
+        a.Add(i);
+        if (i % 2 == 0) b.Add(i);
+        if (i % 3 == 0) c.Add(i);
+    }
+    std::set<uint32_t> result;
+    for (auto key : Intersect(a, b, c)) result.insert(key);
+    assert(result == (std::set<uint32_t>{0, 6, 12, 18, 24}));
+
+    result.clear();
+    for (auto key : Union(b, c)) assert(result.insert(key).second);
+    assert(result.size() == 20);
+
+    result.clear();
+    for (auto key : Difference(b, c)) result.insert(key);
+    assert(result == (std::set<uint32_t>{2, 4, 8, 10, 14, 16, 20, 22, 26, 28}));
+
+    uint32_t keys[] = {0, 1, 2, 3, 6};
+    assert(ContainAll(std::begin(keys), std::end(keys), a, b, c) == 0b10001);
+    // more than 64 keys are checked block by block
+    std::vector<uint32_t> manyKeys(130);
+    std::iota(manyKeys.rbegin(), manyKeys.rend(), 0);
+    auto masks = ContainAllBlocks(manyKeys.begin(), manyKeys.end(), a, b, c);
+    assert(masks.size() == 3);
+    // key k is at 129 - k: 0 -> 129, 6 -> 123, ..., 24 -> 105
+    assert(masks[0] == 0);
+    assert(masks[1] == ((1ull << 41) | (1ull << 47) | (1ull << 53) | (1ull << 59)));
+    assert(masks[2] == (1ull << 1));
+
+    // sorting
+    a.Sort(std::greater<uint32_t>{});
+    for (uint32_t i = 0; i < a.Size(); i++) {
+        assert(a.Data()[i] == 29 - i && a.Index(29 - i) == i);
+    }
+    c.SortAs(a);
+    assert(c.Data()[0] == 27 && c.Data()[c.Size() - 1] == 0);
+
+    SparseMap<uint32_t, int, 10> depth;
+    depth.Add(1, 30);
+    depth.Add(2, 10);
+    depth.Add(3, 20);
+    depth.Sort([&](uint32_t lhs, uint32_t rhs) { return depth.Get(lhs) < depth.Get(rhs); });
+    assert(depth.Keys()[0] == 2 && depth.Keys()[1] == 3 && depth.Keys()[2] == 1);
+    assert(depth.Values()[0] == 10 && depth.Get(1) == 30);
+
+    // bulk insert and erase
+    std::vector<uint32_t> range;
+    for (uint32_t i = 0; i < 1000; i++) {
+        range.push_back(i * 7);
+    }
+    SparseSets<uint32_t, 32> bulk;
+    bulk.Reserve(range.size(), range.back());
+    bulk.AddRange(range.begin(), range.end());
+    bulk.AddRange(range.begin(), range.begin() + 10);
+    assert(bulk.Size() == 1000);
+    bulk.RemoveRange(range.begin(), range.begin() + 500);
+    assert(bulk.Size() == 500);
+    for (size_t i = 0; i < range.size(); i++) {
+        assert(bulk.Contain(range[i]) == (i >= 500));
+    }
+    for (size_t i = 0; i < bulk.Size(); i++) {
+        assert(bulk.Index(bulk.Data()[i]) == i);
+    }
+    bulk.RemoveRange(range.begin() + 500, range.begin() + 510);
+    assert(bulk.Size() == 490);
+    bulk.RemoveRange(range.begin(), range.end());
+    assert(bulk.Size() == 0 && bulk.PageCount() == 0);
+
+    // bitset-backed sets for small dense universes
+    SparseSets<uint16_t, 1024, FlatIndex> visible, dirty;
+    for (uint16_t i = 0; i < 2000; i++) {
+        visible.Add(i);
+        if (i % 10 == 0) dirty.Add(i);
+    }
+    visible.Remove(10);
+    assert(!visible.Contain(10) && visible.Contain(20) && !visible.Contain(5000));
+    size_t count = 0;
+    ForEachBit<uint16_t>(AndBits(visible, dirty), [&](uint16_t key) {
+        assert(key % 10 == 0 && key != 10);
+        count++;
+    });
+    assert(count == 199);
+    count = 0;
+    ForEachBit<uint16_t>(AndNotBits(visible, dirty), [&](uint16_t key) {
+        assert(key % 10 != 0);
+        count++;
+    });
+    assert(count == 1800);
+    for (auto key : Intersect(visible, dirty)) {
+        assert(key % 10 == 0);
+    }
+
+    // lock-free readers with one writer
+    ConcurrentSparseSets<uint32_t, 32> concurrent;
+    for (uint32_t i = 0; i < 1000; i += 2) {
+        concurrent.Add(i);
+    }
+    std::atomic<bool> done = false;
+    std::thread reader([&]() {
+        while (!done) {
+            for (uint32_t i = 0; i < 1000; i += 2) {
+                assert(concurrent.Contain(i));
+            }
+            concurrent.Each([](uint32_t key) { assert(key < 100000); });
+        }
+    });
+    for (uint32_t i = 1; i < 100000; i += 2) {
+        concurrent.Add(i);
+    }
+    for (uint32_t i = 1; i < 100000; i += 2) {
+        concurrent.Remove(i);
+    }
+    done = true;
+    reader.join();
+    concurrent.Reclaim();
+    assert(concurrent.Size() == 500);
+
+    ShardedConcurrentSparseSets<uint32_t, 32> sharded;
+    std::thread writer([&]() {
+        for (uint32_t i = 0; i < 1000; i += 2) sharded.Add(i);
+    });
+    for (uint32_t i = 1; i < 1000; i += 2) {
+        sharded.Add(i);
+    }
+    writer.join();
+    assert(sharded.Size() == 1000);
+
+    SparseMap<uint32_t, float, 10> map;
+    map.Add(3, 0.3f);
+    map.Add(25, 2.5f);
+    map.Add(7, 0.7f);
+    map.Add(3, 3.0f);
+    assert(map.Size() == 3);
+    assert(map.Get(3) == 3.0f);
+
+    map.Remove(3);
+    assert(!map.Contain(3));
+    assert(map.Get(25) == 2.5f && map.Get(7) == 0.7f);
+
+    float sum = 0;
+    for (auto [key, value] : map) {
+        assert(map.Get(key) == value);
+        value *= 2;
+    }
+    for (size_t i = 0; i < map.Size(); i++) {
+        sum += map.Values()[i];
+    }
+    assert(sum == (2.5f + 0.7f) * 2);
+
+    // write into image and use it from a memory mapped file
+    {
+        const char* filename = "sparse_sets_image.bin";
+        {
+            std::ofstream file(filename, std::ios::binary);
+            sparse_sets_image::WriteImage(file, map);
+        }
+
+        using Image = sparse_sets_image::ImageView<uint32_t, 10, float>;
+        sparse_sets_image::MappedFile file(filename, sparse_sets_image::MappedFile::Mode::ReadOnly);
+        assert(file.Valid());
+        auto image = Image::FromMemory(file.Data(), file.Size());
+        assert(image);
+        assert(image->Size() == map.Size());
+        for (auto [key, value] : map) {
+            assert(image->Contain(key));
+            assert(image->Get(key) == value);
+        }
+        assert(!image->Contain(3) && !image->Contain(1000));
+        assert(!(sparse_sets_image::ImageView<uint32_t, 32, float>::FromMemory(file.Data(), file.Size())));
+        assert(!(sparse_sets_image::ImageView<uint32_t, 10>::FromMemory(file.Data(), file.Size())));
+
+        // copy-on-write mapping can be modified, file is untouched
+        sparse_sets_image::MappedFile cow(filename, sparse_sets_image::MappedFile::Mode::CopyOnWrite);
+        auto writable = Image::FromWritableMemory(cow.MutableData(), cow.Size());
+        writable->MutableValues()[writable->Index(25)] = 100;
+        assert(writable->Get(25) == 100 && image->Get(25) == map.Get(25));
+
+        std::remove(filename);
+    }
+
+    // truncated or corrupted images are rejected
+    {
+        using Image = sparse_sets_image::ImageView<uint32_t, 10, float>;
+        using sparse_sets_image::Header;
+        auto valid = sparse_sets_image::BuildImage<uint32_t, 10>(map.Keys(), map.Size(), map.Values(), sizeof(float));
+        assert(Image::FromMemory(valid.data(), valid.size()));
+        assert(!Image::FromMemory(valid.data(), valid.size() - 1));
+        assert(!Image::FromMemory(valid.data(), sizeof(Header) - 1));
+
+        auto rejected = [&](auto modify) {
+            auto image = valid;
+            Header header;
+            std::memcpy(&header, image.data(), sizeof(header));
+            modify(image, header);
+            std::memcpy(image.data(), &header, sizeof(header));
+            return !Image::FromMemory(image.data(), image.size());
+        };
+        // values are cut off, size in header is truncated too
+        assert(rejected([](auto&, Header& h) { h.size = h.valueOffset + sizeof(float); }));
+        // dense keys overflow the image
+        assert(rejected([](auto&, Header& h) { h.count = UINT64_MAX / 2; }));
+        // page table is out of the image
+        assert(rejected([](auto&, Header& h) { h.pageCount = h.size; }));
+        // a page is out of the image
+        assert(rejected([](auto& image, Header& h) {
+            uint32_t key;
+            std::memcpy(&key, image.data() + h.denseOffset, sizeof(key));
+            uint64_t page = h.size - sizeof(uint32_t);
+            std::memcpy(image.data() + h.tableOffset + key / 10 * sizeof(uint64_t), &page, sizeof(page));
+        }));
+        // an index in page is out of the dense array
+        assert(rejected([](auto& image, Header& h) {
+            uint32_t key;
+            std::memcpy(&key, image.data() + h.denseOffset, sizeof(key));
+            uint64_t page;
+            std::memcpy(&page, image.data() + h.tableOffset + key / 10 * sizeof(uint64_t), sizeof(page));
+            uint32_t index = static_cast<uint32_t>(h.count);
+            std::memcpy(image.data() + page + key % 10 * sizeof(uint32_t), &index, sizeof(index));
+        }));
+    }
 }
\ No newline at end of file
@@ -0,0 +1,203 @@
+// compare SparseSets with std containers, groups can be chosen by cmdline:
+//   ./sparse_sets_benchmark "random insert" contains
+#include <algorithm>
+#include <numeric>
+#include <random>
+#include <set>
+#include <unordered_set>
+#include <vector>
+
+#include "sparse_sets.hpp"
+
+// every iteration works on the whole container, a few samples are enough
+#define BENCHMARK_SAMPLE_NUM 10
+#include "benchmark.hpp"
+
+using Key = uint32_t;
+using Keys = std::vector<Key>;
+
+//! @brief a sorted vector, keys are sorted after batch insertion
+struct SortedVector {
+    std::vector<Key> keys;
+};
+
+template <typename Container>
+struct Adapter {
+    static void InsertAll(Container& c, const Keys& keys) {
+        for (auto key : keys) c.Add(key);
+    }
+    static void RemoveAll(Container& c, const Keys& keys) {
+        for (auto key : keys) c.Remove(key);
+    }
+    static bool Contain(const Container& c, Key key) { return c.Contain(key); }
+};
+
+template <typename Container>
+struct StdAdapter {
+    static void InsertAll(Container& c, const Keys& keys) {
+        for (auto key : keys) c.insert(key);
+    }
+    static void RemoveAll(Container& c, const Keys& keys) {
+        for (auto key : keys) c.erase(key);
+    }
+    static bool Contain(const Container& c, Key key) { return c.count(key); }
+};
+
+template <>
+struct Adapter<std::set<Key>> : StdAdapter<std::set<Key>> {};
+
+template <>
+struct Adapter<std::unordered_set<Key>> : StdAdapter<std::unordered_set<Key>> {};
+
+template <>
+struct Adapter<SortedVector> {
+    static void InsertAll(SortedVector& c, const Keys& keys) {
+        c.keys.insert(c.keys.end(), keys.begin(), keys.end());
+        std::sort(c.keys.begin(), c.keys.end());
+    }
+    static void RemoveAll(SortedVector& c, const Keys& keys) {
+        Keys sorted = keys;
+        std::sort(sorted.begin(), sorted.end());
+        Keys result;
+        std::set_difference(c.keys.begin(), c.keys.end(), sorted.begin(),
+                            sorted.end(), std::back_inserter(result));
+        c.keys.swap(result);
+    }
+    static bool Contain(const SortedVector& c, Key key) {
+        return std::binary_search(c.keys.begin(), c.keys.end(), key);
+    }
+};
+
+template <typename Container>
+uint64_t Sum(const Container& c) {
+    uint64_t sum = 0;
+    for (auto key : c) sum += key;
+    return sum;
+}
+
+uint64_t Sum(const SortedVector& c) { return Sum(c.keys); }
+
+//! @brief n unique keys in [0, 4n), sequential or shuffled
+Keys GenKeys(size_t n, bool shuffle) {
+    std::mt19937 rng(static_cast<unsigned>(n));
+    Keys keys(n);
+    for (size_t i = 0; i < n; i++) {
+        keys[i] = static_cast<Key>(i * 4 + rng() % 4);
+    }
+    if (shuffle) {
+        std::shuffle(keys.begin(), keys.end(), rng);
+    }
+    return keys;
+}
+
+//! @brief probes for keys of `GenKeys`, every fourth one hits, others are moved
+//! to another offset of the same slot so they miss
+Keys GenProbes(const Keys& keys) {
+    Keys probes(keys.size());
+    for (size_t i = 0; i < keys.size(); i++) {
+        Key offset = static_cast<Key>(i % 4);
+        probes[i] = (keys[i] & ~Key(3)) | ((keys[i] + offset) & 3);
+    }
+    return probes;
+}
+
+template <typename Container>
+void AddUnits(const char* name) {
+    constexpr int64_t lo = 1000, hi = 10000000, multiplier = 10;
+    BENCHMARK_GROUP("sequential insert") {
+        BENCHMARK_ADD(name, [](benchmark::Measure measure) {
+            Keys keys = GenKeys(measure.Arg(), false);
+            measure([&]() {
+                Container c;
+                Adapter<Container>::InsertAll(c, keys);
+            });
+            measure.SetItemsProcessed(measure.Arg());
+        }).Range(lo, hi, multiplier);
+    }
+    BENCHMARK_GROUP("random insert") {
+        BENCHMARK_ADD(name, [](benchmark::Measure measure) {
+            Keys keys = GenKeys(measure.Arg(), true);
+            measure([&]() {
+                Container c;
+                Adapter<Container>::InsertAll(c, keys);
+            });
+            measure.SetItemsProcessed(measure.Arg());
+        }).Range(lo, hi, multiplier);
+    }
+    BENCHMARK_GROUP("contains") {
+        BENCHMARK_ADD(name, [](benchmark::Measure measure) {
+            Container c;
+            Keys keys = GenKeys(measure.Arg(), true);
+            Adapter<Container>::InsertAll(c, keys);
+            // a quarter of probes hit
+            Keys probes = GenProbes(keys);
+            measure([&]() {
+                uint64_t hits = 0;
+                for (auto key : probes) {
+                    hits += Adapter<Container>::Contain(c, key);
+                }
+                return hits;
+            });
+            measure.SetItemsProcessed(measure.Arg());
+        }).Range(lo, hi, multiplier);
+    }
+    BENCHMARK_GROUP("remove") {
+        BENCHMARK_ADD(name, [](benchmark::Measure measure) {
+            Keys keys = GenKeys(measure.Arg(), true);
+            Container c;
+            // every iteration needs a filled container, refill out of timing
+            measure([&]() {
+                measure.PauseTiming();
+                Adapter<Container>::InsertAll(c, keys);
+                measure.ResumeTiming();
+                Adapter<Container>::RemoveAll(c, keys);
+            });
+            measure.SetItemsProcessed(measure.Arg());
+        }).Range(lo, hi, multiplier);
+    }
+    BENCHMARK_GROUP("iterate") {
+        BENCHMARK_ADD(name, [](benchmark::Measure measure) {
+            Container c;
+            Adapter<Container>::InsertAll(c, GenKeys(measure.Arg(), true));
+            measure([&]() { return Sum(c); });
+            measure.SetItemsProcessed(measure.Arg());
+        }).Range(lo, hi, multiplier);
+    }
+}
+
+//! @brief readers of ConcurrentSparseSets don't lock, throughput should scale
+//! with threads
+void AddConcurrentUnits() {
+    static ConcurrentSparseSets<Key, 256> set;
+    Keys keys = GenKeys(100000, true);
+    for (auto key : keys) {
+        set.Add(key);
+    }
+    // a quarter of probes hit
+    static Keys probes = GenProbes(keys);
+    BENCHMARK_GROUP("concurrent contains") {
+        BENCHMARK_ADD("ConcurrentSparseSets<256>", [](benchmark::Measure measure) {
+            measure([&]() {
+                uint64_t hits = 0;
+                for (auto key : probes) {
+                    hits += set.Contain(key);
+                }
+                return hits;
+            });
+            measure.SetItemsProcessed(probes.size());
+        }).Threads(2).Threads(4).Threads(8);
+    }
+}
+
+BENCHMARK_MAIN {
+    AddUnits<SparseSets<Key, 32>>("SparseSets<32>");
+    AddUnits<SparseSets<Key, 256>>("SparseSets<256>");
+    AddUnits<SparseSets<Key, 4096>>("SparseSets<4096>");
+    AddUnits<SparseSets<Key, 4096, FlatIndex>>("SparseSets<4096, FlatIndex>");
+    AddUnits<std::unordered_set<Key>>("std::unordered_set");
+    AddUnits<std::set<Key>>("std::set");
+    AddUnits<SortedVector>("sorted vector");
+    AddConcurrentUnits();
+
+    BENCHMARK_RUN();
+}
@@ -1,9 +1,13 @@
 #pragma once
 #include <algorithm>
 #include <cassert>
+#include <deque>
 #include <functional>
+#include <mutex>
 #include <optional>
+#include <string_view>
 #include <unordered_map>
+#include <unordered_set>
 #include <variant>
 #include <vector>
 
@@ -39,16 +43,72 @@ struct Node final {
 
 namespace ecs {
 
+//! @brief get type name in compile time
+//! @note the name depends on compiler, but is the same between translation
+//! units, shared libraries and runs
+template <typename T>
+constexpr std::string_view TypeName() {
+#if defined(_MSC_VER) && !defined(__clang__)
+    std::string_view name = __FUNCSIG__;
+    auto begin = name.find("TypeName<") + 9;
+    auto end = name.rfind(">(void)");
+#else
+    std::string_view name = __PRETTY_FUNCTION__;
+    auto begin = name.find("T = ") + 4;
+    auto end = name.find_first_of(";]", begin);
+#endif
+    return name.substr(begin, end - begin);
+}
+
+//! @brief FNV-1a hash
+constexpr uint32_t HashString(std::string_view str) {
+    uint32_t hash = 2166136261u;
+    for (char c : str) {
+        hash ^= static_cast<uint8_t>(c);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+//! @brief stable type ID, hash of type name
+//! @note types with the same name(eg: in anonymous namespaces of different
+//! translation units, or lambdas on GCC) have the same `TypeID`, use
+//! `IndexGetter::Get` which tells them apart
+template <typename T>
+constexpr ComponentID TypeID() {
+    return HashString(TypeName<T>());
+}
+
+//! @brief component ID of type, `TypeID` unless it collides
+//! @note a type whose `TypeID` is already used by another type(a hash
+//! collision, or a type with the same name) gets a fallback ID, which depends
+//! on the order types are first used, so it isn't stable between runs
 class IndexGetter final {
 public:
     template <typename T>
-    static uint32_t Get() {
-        static uint32_t id = curIdx_++;
+    static ComponentID Get() {
+        // checked once per type, in release builds too
+        static ComponentID id = registerType(TypeID<T>(), &tag<T>);
         return id;
     }
 
 private:
-    inline static uint32_t curIdx_ = 0;
+    //! a distinct address for every type, even if type names are the same
+    template <typename T>
+    inline static char tag = 0;
+
+    static ComponentID registerType(ComponentID id, const void *tag) {
+        static std::mutex mutex;
+        static std::unordered_map<ComponentID, const void *> types;
+        std::lock_guard<std::mutex> lock(mutex);
+        while (true) {
+            auto [it, inserted] = types.emplace(id, tag);
+            if (inserted || it->second == tag) {
+                return id;
+            }
+            id = id * 16777619u + 1;
+        }
+    }
 };
 
 template <typename T, typename = std::enable_if<std::is_integral_v<T>>>
@@ -196,6 +256,7 @@ public:
     friend class Resources;
     friend class Querier;
     friend class CondQuerier;
+    friend class lua_bind::QuerierWrapper;
     using ComponentContainer = std::unordered_map<ComponentID, void *>;
     using EntityContainer = std::unordered_map<Entity, ComponentContainer>;
 
@@ -232,6 +293,60 @@ public:
     void Startup();
     void Update();
 
+    //! @brief move entities into another world without re-spawning their
+    //! components
+    //! @param dst the world entities will be moved to
+    //! @param entities entities to move, children of entities which have
+    //! `Node` are moved together
+    //! @return a map from entity in this world to entity in `dst`(entity keeps
+    //! its ID unless it is already used in `dst`)
+    std::unordered_map<Entity, Entity> MoveEntities(
+        World &dst, const std::vector<Entity> &entities);
+
+    //! @brief memory usage in bytes
+    struct MemoryUsage final {
+        size_t used = 0;      //!< bytes hold by alive elements
+        size_t reserved = 0;  //!< bytes allocated, include `used`
+    };
+
+    //! @brief memory usage of the world
+    //! @note component and resource sizes are `sizeof` of the type, memory
+    //! owned by them(like a `std::string` member) is not counted
+    struct MemoryStatistics final {
+        //! component instances in pool(`reserved` include cached instances)
+        std::unordered_map<ComponentID, MemoryUsage> components;
+        std::unordered_map<ComponentID, MemoryUsage> sparseSets;
+        MemoryUsage resources;
+        //! `Commands` of systems kept by `Update`, only the capacity survives
+        //! between frames: queued commands are executed and dropped at the
+        //! end of `Update`
+        MemoryUsage commandBuffers;
+
+        MemoryUsage Total() const {
+            MemoryUsage total;
+            auto add = [&](const MemoryUsage &usage) {
+                total.used += usage.used;
+                total.reserved += usage.reserved;
+            };
+            for (auto &[_, usage] : components) {
+                add(usage);
+            }
+            for (auto &[_, usage] : sparseSets) {
+                add(usage);
+            }
+            add(resources);
+            add(commandBuffers);
+            return total;
+        }
+    };
+
+    MemoryStatistics MemoryStats() const;
+
+    //! @brief release cached component instances, empty sparse pages and
+    //! unused buffers
+    //! @param budget bytes of cached component instances allowed to keep
+    void Trim(size_t budget = 0);
+
     void Shutdown() {
         entities_.clear();
         resources_.clear();
@@ -251,9 +366,10 @@ private:
 
         CreateFunc create;
         DestroyFunc destroy;
+        size_t elemSize;
 
-        Pool(CreateFunc create, DestroyFunc destroy)
-            : create(create), destroy(destroy) {
+        Pool(CreateFunc create, DestroyFunc destroy, size_t elemSize)
+            : create(create), destroy(destroy), elemSize(elemSize) {
             assertm("you must give a non-nullptr create func", create);
             assertm("you must give a non-nullptr destroy func", create);
         }
@@ -278,19 +394,139 @@ private:
                 assertm("your element not in pool", false);
             }
         }
+
+        //! @brief remove elements from pool without destroying them, the
+        //! ownership is transferred to the caller
+        //! @note one pass over the pool for the whole batch, release all
+        //! elements of a type in one call instead of one call per element
+        void Release(const std::vector<void *> &elems) {
+            std::unordered_set<void *> released(elems.begin(), elems.end());
+            instances.erase(
+                std::remove_if(instances.begin(), instances.end(),
+                               [&](void *elem) { return released.count(elem); }),
+                instances.end());
+        }
+
+        //! @brief take ownership of elements released from another pool
+        void Adopt(const std::vector<void *> &elems) {
+            instances.insert(instances.end(), elems.begin(), elems.end());
+        }
     };
 
     struct ComponentInfo {
         Pool pool;
         SparseSets<Entity, 32> sparseSet;
 
-        ComponentInfo(Pool::CreateFunc create, Pool::DestroyFunc destroy)
-            : pool(create, destroy) {}
+        ComponentInfo(Pool::CreateFunc create, Pool::DestroyFunc destroy,
+                      size_t elemSize)
+            : pool(create, destroy, elemSize) {}
 
-        ComponentInfo() : pool(nullptr, nullptr) {}
+        ComponentInfo() : pool(nullptr, nullptr, 0) {}
+    };
+
+    //! @brief component infos of the world, looked up by a perfect hash of
+    //! component ID
+    //! @note the hash is rebuilt when a new component type is added, which
+    //! happens once per type, so lookups never probe or chain. Infos are
+    //! dense in the order they are added and never move(`ComponentInfo *`
+    //! stays valid)
+    class ComponentMap final {
+    public:
+        using value_type = std::pair<const ComponentID, ComponentInfo>;
+        using iterator = std::deque<value_type>::iterator;
+        using const_iterator = std::deque<value_type>::const_iterator;
+
+        iterator begin() { return infos_.begin(); }
+        iterator end() { return infos_.end(); }
+        const_iterator begin() const { return infos_.begin(); }
+        const_iterator end() const { return infos_.end(); }
+        size_t size() const { return infos_.size(); }
+
+        iterator find(ComponentID id) {
+            auto index = indexOf(id);
+            return index ? infos_.begin() + *index : infos_.end();
+        }
+
+        const_iterator find(ComponentID id) const {
+            auto index = indexOf(id);
+            return index ? infos_.begin() + *index : infos_.end();
+        }
+
+        //! @brief add info of a new component type, keep the old one if `id`
+        //! exists
+        std::pair<iterator, bool> emplace(ComponentID id, ComponentInfo &&info) {
+            if (auto it = find(id); it != end()) {
+                return {it, false};
+            }
+            infos_.emplace_back(id, std::move(info));
+            rebuild();
+            return {infos_.end() - 1, true};
+        }
+
+        ComponentInfo &operator[](ComponentID id) {
+            auto it = find(id);
+            assertm("component type not registered in world", it != end());
+            return it->second;
+        }
+
+        void clear() {
+            infos_.clear();
+            slots_.clear();
+        }
+
+    private:
+        std::deque<value_type> infos_;
+        std::vector<uint32_t> slots_;  //!< dense index + 1, 0 means empty
+        uint32_t seed_ = 0;
+        uint32_t bits_ = 0;
+
+        uint32_t slot(ComponentID id) const {
+            return static_cast<uint32_t>(((id ^ seed_) * 2654435761u) >>
+                                         (32 - bits_));
+        }
+
+        std::optional<size_t> indexOf(ComponentID id) const {
+            if (slots_.empty()) {
+                return std::nullopt;
+            }
+            auto index = slots_[slot(id)];
+            if (index != 0 && infos_[index - 1].first == id) {
+                return index - 1;
+            }
+            return std::nullopt;
+        }
+
+        //! try seeds until every ID gets its own slot, grow the table when
+        //! none works, load factor is kept under 1/2
+        void rebuild() {
+            bits_ = 1;
+            while ((size_t(1) << bits_) < infos_.size() * 2) {
+                bits_++;
+            }
+            while (true) {
+                for (seed_ = 0; seed_ < 256; seed_++) {
+                    if (tryBuild()) {
+                        return;
+                    }
+                }
+                assertm("can't build perfect hash of component IDs", bits_ < 32);
+                bits_++;
+            }
+        }
+
+        bool tryBuild() {
+            slots_.assign(size_t(1) << bits_, 0);
+            for (uint32_t i = 0; i < infos_.size(); i++) {
+                auto &s = slots_[slot(infos_[i].first)];
+                if (s != 0) {
+                    return false;
+                }
+                s = i + 1;
+            }
+            return true;
+        }
     };
 
-    using ComponentMap = std::unordered_map<ComponentID, ComponentInfo>;
     ComponentMap componentMap_;
     EntityContainer entities_;
     std::vector<std::unique_ptr<Plugins>> pluginsList_;
@@ -299,8 +535,10 @@ private:
         void *resource = nullptr;
         using DestroyFunc = void (*)(void *);
         DestroyFunc destroy = nullptr;
+        size_t size = 0;
 
-        ResourceInfo(DestroyFunc destroy) : destroy(destroy) {
+        ResourceInfo(DestroyFunc destroy, size_t size)
+            : destroy(destroy), size(size) {
             assertm("you must give a non-null destroy function", destroy);
         }
 
@@ -310,6 +548,7 @@ private:
     std::unordered_map<ComponentID, ResourceInfo> resources_;
     std::vector<StartupSystem> startupSystems_;
     std::vector<UpdateSystem> updateSystems_;
+    std::vector<Commands> commandList_;
 };
 
 class Resources final {
@@ -415,6 +654,8 @@ constexpr auto IsConditionV = IsCondition<T>::value;
 //! @see Without With Option
 class Querier final {
 public:
+    friend class lua_bind::QuerierWrapper;
+
     Querier(World &world) : world_(world) {}
 
     /* IMPROVE: currently it iterate all entities,
@@ -679,7 +920,8 @@ public:
         } else {
             auto newIt = world_.resources_.insert_or_assign(
                 index,
-                World::ResourceInfo([](void *elem) { delete (T *)elem; }));
+                World::ResourceInfo([](void *elem) { delete (T *)elem; },
+                                    sizeof(T)));
             newIt.first->second.resource =
                 new T(std::move(std::forward<T>(resource)));
         }
@@ -759,6 +1001,7 @@ private:
         World::Pool::CreateFunc create;
         World::Pool::DestroyFunc destroy;
         ComponentID index;
+        size_t size;
     };
 
     struct EntitySpawnInfo {
@@ -790,6 +1033,7 @@ private:
         info.index = IndexGetter::Get<T>();
         info.create = [](void) -> void * { return new T; };
         info.destroy = [](void *elem) { delete (T *)elem; };
+        info.size = sizeof(T);
         info.assign = [=, c = std::move(component)](void *elem) mutable { *((T *)elem) = std::move(c); };
         spawnInfo.push_back(info);
 
@@ -799,12 +1043,15 @@ private:
     }
 
     void *doSpawnWithoutType(Entity entity, ComponentSpawnInfo &info) {
-        if (auto it = world_.componentMap_.find(info.index);
-            it == world_.componentMap_.end()) {
-            world_.componentMap_.insert_or_assign(
-                info.index, World::ComponentInfo(info.create, info.destroy));
+        auto it = world_.componentMap_.find(info.index);
+        if (it == world_.componentMap_.end()) {
+            it = world_.componentMap_
+                     .emplace(info.index, World::ComponentInfo(
+                                              info.create, info.destroy,
+                                              info.size))
+                     .first;
         }
-        World::ComponentInfo &componentInfo = world_.componentMap_[info.index];
+        World::ComponentInfo &componentInfo = it->second;
         void *elem = componentInfo.pool.Create();
         info.assign(elem);
         componentInfo.sparseSet.Add(entity);
@@ -905,7 +1152,7 @@ inline void PreorderVisit(std::optional<Entity> parent, Entity entity,
 }
 
 inline void World::Update() {
-    std::vector<Commands> commandList;
+    auto &commandList = commandList_;
 
     Events events;
     Querier querier{*this};
@@ -965,6 +1212,170 @@ inline void World::Update() {
     for (auto &commands : commandList) {
         commands.Execute();
     }
+    // keep the capacity for next frame, `Trim()` will release it
+    commandList.clear();
+}
+
+inline std::unordered_map<Entity, Entity> World::MoveEntities(
+    World &dst, const std::vector<Entity> &entities) {
+    std::unordered_map<Entity, Entity> remap;
+    if (&dst == this) {
+        for (auto entity : entities) {
+            remap[entity] = entity;
+        }
+        return remap;
+    }
+
+    auto nodeIndex = IndexGetter::Get<Node>();
+    auto getNode = [=](ComponentContainer &components) -> Node * {
+        auto it = components.find(nodeIndex);
+        return it == components.end() ? nullptr : (Node *)it->second;
+    };
+
+    // collect entities with their whole subtree
+    std::vector<Entity> moving;
+    std::vector<Entity> stack;
+    for (auto entity : entities) {
+        stack.push_back(entity);
+        while (!stack.empty()) {
+            auto e = stack.back();
+            stack.pop_back();
+            auto it = entities_.find(e);
+            if (it == entities_.end() || remap.count(e)) {
+                continue;
+            }
+            remap[e] = dst.entities_.count(e) ? EntityGenerator::Gen() : e;
+            moving.push_back(e);
+            if (auto node = getNode(it->second); node) {
+                stack.insert(stack.end(), node->children.begin(),
+                             node->children.end());
+            }
+        }
+    }
+
+    // detach moved subtrees from parents which stay in this world
+    for (auto e : moving) {
+        auto node = getNode(entities_[e]);
+        if (node && node->parent && !remap.count(node->parent.value())) {
+            if (auto it = entities_.find(node->parent.value());
+                it != entities_.end()) {
+                if (auto parentNode = getNode(it->second); parentNode) {
+                    auto &children = parentNode->children;
+                    children.erase(
+                        std::remove(children.begin(), children.end(), e),
+                        children.end());
+                }
+            }
+            node->parent = std::nullopt;
+        }
+    }
+
+    std::unordered_map<ComponentID, std::vector<void *>> movedComponents;
+    for (auto e : moving) {
+        auto it = entities_.find(e);
+        auto newEntity = remap.at(e);
+        for (auto &[id, component] : it->second) {
+            movedComponents[id].push_back(component);
+
+            auto &srcInfo = componentMap_[id];
+            srcInfo.sparseSet.Remove(e);
+            auto dstIt = dst.componentMap_.find(id);
+            if (dstIt == dst.componentMap_.end()) {
+                dstIt = dst.componentMap_
+                            .emplace(id, ComponentInfo(srcInfo.pool.create,
+                                                       srcInfo.pool.destroy,
+                                                       srcInfo.pool.elemSize))
+                            .first;
+            }
+            dstIt->second.sparseSet.Add(newEntity);
+        }
+
+        if (auto node = getNode(it->second); node) {
+            if (node->parent) {
+                auto parent = remap.find(node->parent.value());
+                node->parent = parent == remap.end()
+                                   ? std::nullopt
+                                   : std::optional<Entity>(parent->second);
+            }
+            // stale children(eg: destroyed without a Node) aren't moved,
+            // drop them instead of mapping them to a bogus entity
+            auto &children = node->children;
+            children.erase(std::remove_if(children.begin(), children.end(),
+                                          [&](Entity child) {
+                                              return !remap.count(child);
+                                          }),
+                           children.end());
+            for (auto &child : children) {
+                child = remap.at(child);
+            }
+        }
+
+        dst.entities_.emplace(newEntity, std::move(it->second));
+        entities_.erase(it);
+    }
+
+    for (auto &[id, components] : movedComponents) {
+        componentMap_[id].pool.Release(components);
+        dst.componentMap_[id].pool.Adopt(components);
+    }
+
+    return remap;
+}
+
+inline World::MemoryStatistics World::MemoryStats() const {
+    MemoryStatistics stats;
+    for (auto &[id, info] : componentMap_) {
+        auto &pool = info.pool;
+        auto &usage = stats.components[id];
+        usage.used = pool.instances.size() * pool.elemSize;
+        usage.reserved =
+            (pool.instances.size() + pool.cache.size()) * pool.elemSize +
+            (pool.instances.capacity() + pool.cache.capacity()) *
+                sizeof(void *);
+
+        auto &setUsage = stats.sparseSets[id];
+        setUsage.used = info.sparseSet.Size() * sizeof(Entity);
+        setUsage.reserved = info.sparseSet.MemoryUsage();
+    }
+    for (auto &[_, info] : resources_) {
+        if (info.resource) {
+            stats.resources.used += info.size;
+            stats.resources.reserved += info.size;
+        }
+        stats.resources.reserved += sizeof(ResourceInfo);
+    }
+    stats.commandBuffers.used = commandList_.size() * sizeof(Commands);
+    stats.commandBuffers.reserved = commandList_.capacity() * sizeof(Commands);
+    return stats;
+}
+
+inline void World::Trim(size_t budget) {
+    size_t cached = 0;
+    for (auto &[_, info] : componentMap_) {
+        cached += info.pool.cache.size() * info.pool.elemSize;
+    }
+
+    for (auto &[_, info] : componentMap_) {
+        auto &pool = info.pool;
+        while (cached > budget && !pool.cache.empty()) {
+            pool.destroy(pool.cache.back());
+            pool.cache.pop_back();
+            cached -= pool.elemSize;
+        }
+        pool.cache.shrink_to_fit();
+        pool.instances.shrink_to_fit();
+        info.sparseSet.ShrinkToFit();
+    }
+
+    for (auto it = resources_.begin(); it != resources_.end();) {
+        if (!it->second.resource) {
+            it = resources_.erase(it);
+        } else {
+            it++;
+        }
+    }
+
+    commandList_.shrink_to_fit();
 }
 
 template <typename T>
@@ -0,0 +1,433 @@
+//! @file ecs_luabind.hpp
+//! @brief bind ecs.hpp to lua, lua scripts can add systems and query
+//! components in batch
+
+#pragma once
+
+#include "ecs.hpp"
+#include "luabind.hpp"
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace lua_bind {
+
+//! @brief type-erased operations of a component type bound to lua
+struct ComponentOps final {
+    ecs::ComponentID id;
+    sol::object (*ref)(lua_State *, void *);
+    ecs::Entity (*spawn)(ecs::Commands &, sol::object);
+    void (*add)(ecs::Commands &, ecs::Entity, sol::object);
+    void (*destroy)(ecs::Commands &, ecs::Entity);
+};
+
+//! @brief type-erased operations of a resource type bound to lua
+struct ResourceOps final {
+    bool (*has)(ecs::Resources &);
+    sol::object (*get)(lua_State *, ecs::Resources &);
+};
+
+//! @brief type-erased operations of an event type bound to lua
+struct EventOps final {
+    bool (*has)(ecs::Events &);
+    sol::object (*read)(lua_State *, ecs::Events &);
+    void (*write)(ecs::Events &, sol::object);
+};
+
+class LuaECS;
+
+class CommandsWrapper final {
+public:
+    CommandsWrapper(ecs::Commands &cmds, LuaECS &ecs)
+        : cmds_(cmds), ecs_(ecs) {}
+
+    //! @brief spawn an entity
+    //! @param components a table like `{Name = Name.new("foo"), ...}`
+    ecs::Entity Spawn(sol::table components);
+    void AddComponent(ecs::Entity entity, const std::string &name,
+                      sol::object component);
+    void DestroyComponent(ecs::Entity entity, const std::string &name);
+    void DestroyEntity(ecs::Entity entity) { cmds_.DestroyEntity(entity); }
+
+private:
+    ecs::Commands &cmds_;
+    LuaECS &ecs_;
+};
+
+class QuerierWrapper final {
+public:
+    QuerierWrapper(ecs::Querier querier, LuaECS &ecs);
+
+    //! @brief query entities which have all components
+    //! @return array of entities
+    sol::table Query(sol::variadic_args names, sol::this_state s);
+
+    //! @brief query entities which have all components, fill them into `out`
+    //! in one call
+    //! @param out a table reused between frames, after filling
+    //! `out.entities[i]` is the i-th entity, `out[name][i]` is its component
+    //! and `out.n` is the count. Entries left from a larger previous fill are
+    //! cleared, so `#` and `ipairs` see exactly `n` elements
+    //! @return count of entities
+    size_t Fill(sol::table out, sol::variadic_args names, sol::this_state s);
+
+    sol::object Get(ecs::Entity entity, const std::string &name,
+                    sol::this_state s);
+    bool Has(ecs::Entity entity, const std::string &name);
+    bool Alive(ecs::Entity entity) { return querier_.Alive(entity); }
+
+private:
+    ecs::Querier querier_;
+    ecs::World &world_;
+    LuaECS &ecs_;
+
+    //! @brief collect component infos, return false if any component never
+    //! be spawned
+    bool collect(sol::variadic_args names,
+                 std::vector<const ComponentOps *> &ops,
+                 std::vector<ecs::World::ComponentInfo *> &infos);
+
+    template <typename F>
+    void each(const std::vector<ecs::World::ComponentInfo *> &infos, F f);
+};
+
+class ResourcesWrapper final {
+public:
+    ResourcesWrapper(ecs::Resources res, LuaECS &ecs) : res_(res), ecs_(ecs) {}
+
+    bool Has(const std::string &name);
+    sol::object Get(const std::string &name, sol::this_state s);
+
+private:
+    ecs::Resources res_;
+    LuaECS &ecs_;
+};
+
+class EventsWrapper final {
+public:
+    EventsWrapper(ecs::Events &events, LuaECS &ecs)
+        : events_(events), ecs_(ecs) {}
+
+    bool Has(const std::string &name);
+    sol::object Read(const std::string &name, sol::this_state s);
+    void Write(const std::string &name, sol::object event);
+
+private:
+    ecs::Events &events_;
+    LuaECS &ecs_;
+};
+
+//! @brief bind ecs to a lua state, lua scripts can add systems by
+//! `ecs.AddSystem(function(cmds, querier, res, events) ... end)`
+//! @note types must be bound to lua(eg: `luabind::BindClass`) before use them
+//! as component/resource/event in lua. Put `LuaECS*` into world as resource
+//! and add `LuaSystemsRunner` as system to run lua systems
+class LuaECS final {
+public:
+    friend class CommandsWrapper;
+    friend class QuerierWrapper;
+    friend class ResourcesWrapper;
+    friend class EventsWrapper;
+
+    explicit LuaECS(sol::state &lua) : lua_(lua) {
+        lua.new_usertype<CommandsWrapper>(
+            "Commands", sol::no_constructor, "Spawn", &CommandsWrapper::Spawn,
+            "AddComponent", &CommandsWrapper::AddComponent, "DestroyComponent",
+            &CommandsWrapper::DestroyComponent, "DestroyEntity",
+            &CommandsWrapper::DestroyEntity);
+        lua.new_usertype<QuerierWrapper>(
+            "Querier", sol::no_constructor, "Query", &QuerierWrapper::Query,
+            "Fill", &QuerierWrapper::Fill, "Get", &QuerierWrapper::Get, "Has",
+            &QuerierWrapper::Has, "Alive", &QuerierWrapper::Alive);
+        lua.new_usertype<ResourcesWrapper>(
+            "Resources", sol::no_constructor, "Has", &ResourcesWrapper::Has,
+            "Get", &ResourcesWrapper::Get);
+        lua.new_usertype<EventsWrapper>(
+            "Events", sol::no_constructor, "Has", &EventsWrapper::Has, "Read",
+            &EventsWrapper::Read, "Write", &EventsWrapper::Write);
+
+        sol::table ecs = lua.create_named_table("ecs");
+        ecs.set_function("AddSystem", [this](sol::protected_function system) {
+            systems_.push_back(system);
+        });
+    }
+
+    LuaECS(const LuaECS &) = delete;
+    LuaECS &operator=(const LuaECS &) = delete;
+
+    template <typename T>
+    LuaECS &BindComponent(const std::string &name) {
+        components_[name] = ComponentOps{
+            ecs::IndexGetter::Get<T>(),
+            [](lua_State *L, void *elem) {
+                return sol::make_object(L, static_cast<T *>(elem));
+            },
+            [](ecs::Commands &cmds, sol::object obj) {
+                T component = obj.as<T>();
+                return cmds.SpawnAndReturn(std::move(component));
+            },
+            [](ecs::Commands &cmds, ecs::Entity entity, sol::object obj) {
+                T component = obj.as<T>();
+                cmds.AddComponent(entity, std::move(component));
+            },
+            [](ecs::Commands &cmds, ecs::Entity entity) {
+                cmds.DestroyComponent<T>(entity);
+            }};
+        return *this;
+    }
+
+    template <typename T>
+    LuaECS &BindResource(const std::string &name) {
+        resources_[name] = ResourceOps{
+            [](ecs::Resources &res) { return res.Has<T>(); },
+            [](lua_State *L, ecs::Resources &res) {
+                return sol::make_object(L, &res.Get<T>());
+            }};
+        return *this;
+    }
+
+    template <typename T>
+    LuaECS &BindEvent(const std::string &name) {
+        events_[name] = EventOps{
+            [](ecs::Events &events) { return events.Reader<T>().Has(); },
+            [](lua_State *L, ecs::Events &events) {
+                auto reader = events.Reader<T>();
+                return reader.Has() ? sol::make_object(L, reader.Read())
+                                    : sol::make_object(L, sol::lua_nil);
+            },
+            [](ecs::Events &events, sol::object obj) {
+                events.Writer<T>().Write(obj.as<T>());
+            }};
+        return *this;
+    }
+
+    //! @brief run all systems added by lua
+    void RunSystems(ecs::Commands &cmds, ecs::Querier querier,
+                    ecs::Resources res, ecs::Events &events) {
+        CommandsWrapper cmdsWrapper(cmds, *this);
+        QuerierWrapper querierWrapper(querier, *this);
+        ResourcesWrapper resWrapper(res, *this);
+        EventsWrapper eventsWrapper(events, *this);
+        for (auto &system : systems_) {
+            sol::protected_function_result result =
+                system(std::ref(cmdsWrapper), std::ref(querierWrapper),
+                       std::ref(resWrapper), std::ref(eventsWrapper));
+            if (!result.valid()) {
+                sol::error err = result;
+                LOGE("lua system failed: ", err.what());
+            }
+        }
+    }
+
+private:
+    sol::state &lua_;
+    std::unordered_map<std::string, ComponentOps> components_;
+    std::unordered_map<std::string, ResourceOps> resources_;
+    std::unordered_map<std::string, EventOps> events_;
+    std::vector<sol::protected_function> systems_;
+
+    const ComponentOps &component(const std::string &name) const {
+        auto it = components_.find(name);
+        if (it == components_.end()) {
+            throw sol::error("component " + name + " not bound to lua");
+        }
+        return it->second;
+    }
+
+    const ResourceOps &resource(const std::string &name) const {
+        auto it = resources_.find(name);
+        if (it == resources_.end()) {
+            throw sol::error("resource " + name + " not bound to lua");
+        }
+        return it->second;
+    }
+
+    const EventOps &event(const std::string &name) const {
+        auto it = events_.find(name);
+        if (it == events_.end()) {
+            throw sol::error("event " + name + " not bound to lua");
+        }
+        return it->second;
+    }
+};
+
+//! @brief an ecs system to run lua systems, world must have `LuaECS*`
+//! resource
+inline void LuaSystemsRunner(ecs::Commands &cmds, ecs::Querier querier,
+                             ecs::Resources res, ecs::Events &events) {
+    if (res.Has<LuaECS *>()) {
+        res.Get<LuaECS *>()->RunSystems(cmds, querier, res, events);
+    }
+}
+
+inline ecs::Entity CommandsWrapper::Spawn(sol::table components) {
+    std::optional<ecs::Entity> entity;
+    for (auto &[key, value] : components) {
+        auto &ops = ecs_.component(key.as<std::string>());
+        if (!entity) {
+            entity = ops.spawn(cmds_, value);
+        } else {
+            ops.add(cmds_, entity.value(), value);
+        }
+    }
+    return entity ? entity.value() : cmds_.SpawnAndReturn();
+}
+
+inline void CommandsWrapper::AddComponent(ecs::Entity entity,
+                                          const std::string &name,
+                                          sol::object component) {
+    ecs_.component(name).add(cmds_, entity, component);
+}
+
+inline void CommandsWrapper::DestroyComponent(ecs::Entity entity,
+                                              const std::string &name) {
+    ecs_.component(name).destroy(cmds_, entity);
+}
+
+inline QuerierWrapper::QuerierWrapper(ecs::Querier querier, LuaECS &ecs)
+    : querier_(querier), world_(querier.world_), ecs_(ecs) {}
+
+inline bool QuerierWrapper::collect(
+    sol::variadic_args names, std::vector<const ComponentOps *> &ops,
+    std::vector<ecs::World::ComponentInfo *> &infos) {
+    bool found = true;
+    for (auto name : names) {
+        auto &componentOps = ecs_.component(name.as<std::string>());
+        ops.push_back(&componentOps);
+        if (auto it = world_.componentMap_.find(componentOps.id);
+            it != world_.componentMap_.end()) {
+            infos.push_back(&it->second);
+        } else {
+            found = false;
+        }
+    }
+    return found && !infos.empty();
+}
+
+template <typename F>
+void QuerierWrapper::each(const std::vector<ecs::World::ComponentInfo *> &infos,
+                          F f) {
+    // iterate the smallest sparse set and probe others
+    auto smallest = *std::min_element(
+        infos.begin(), infos.end(), [](auto lhs, auto rhs) {
+            return lhs->sparseSet.Size() < rhs->sparseSet.Size();
+        });
+    for (auto entity : smallest->sparseSet) {
+        bool hasAll = std::all_of(infos.begin(), infos.end(), [=](auto info) {
+            return info->sparseSet.Contain(entity);
+        });
+        if (hasAll) {
+            f(entity);
+        }
+    }
+}
+
+inline sol::table QuerierWrapper::Query(sol::variadic_args names,
+                                        sol::this_state s) {
+    sol::state_view lua(s);
+    std::vector<const ComponentOps *> ops;
+    std::vector<ecs::World::ComponentInfo *> infos;
+    if (!collect(names, ops, infos)) {
+        return lua.create_table();
+    }
+
+    sol::table entities = lua.create_table(infos.front()->sparseSet.Size(), 0);
+    size_t n = 0;
+    each(infos, [&](ecs::Entity entity) { entities.raw_set(++n, entity); });
+    return entities;
+}
+
+inline size_t QuerierWrapper::Fill(sol::table out, sol::variadic_args names,
+                                   sol::this_state s) {
+    sol::state_view lua(s);
+    std::vector<const ComponentOps *> ops;
+    std::vector<ecs::World::ComponentInfo *> infos;
+    bool found = collect(names, ops, infos);
+
+    auto column = [&](const char *name) {
+        sol::optional<sol::table> table = out.raw_get<sol::optional<sol::table>>(name);
+        if (!table) {
+            table = lua.create_table();
+            out.raw_set(name, table.value());
+        }
+        return table.value();
+    };
+
+    sol::table entities = column("entities");
+    std::vector<sol::table> columns;
+    for (auto name : names) {
+        columns.push_back(column(name.as<const char *>()));
+    }
+
+    size_t n = 0;
+    if (found) {
+        each(infos, [&](ecs::Entity entity) {
+            n++;
+            entities.raw_set(n, entity);
+            auto &components = world_.entities_.find(entity)->second;
+            for (size_t i = 0; i < ops.size(); i++) {
+                columns[i].raw_set(
+                    n, ops[i]->ref(s, components.find(ops[i]->id)->second));
+            }
+        });
+    }
+    // clear the tail left by a previous fill, elements are always contiguous
+    auto clearTail = [&](sol::table &table) {
+        for (size_t i = n + 1;
+             table.raw_get<sol::object>(i).get_type() != sol::type::lua_nil;
+             i++) {
+            table.raw_set(i, sol::lua_nil);
+        }
+    };
+    clearTail(entities);
+    for (auto &table : columns) {
+        clearTail(table);
+    }
+    out.raw_set("n", n);
+    return n;
+}
+
+inline sol::object QuerierWrapper::Get(ecs::Entity entity,
+                                       const std::string &name,
+                                       sol::this_state s) {
+    auto &ops = ecs_.component(name);
+    if (auto it = world_.entities_.find(entity); it != world_.entities_.end()) {
+        if (auto cit = it->second.find(ops.id); cit != it->second.end()) {
+            return ops.ref(s, cit->second);
+        }
+    }
+    return sol::make_object(s, sol::lua_nil);
+}
+
+inline bool QuerierWrapper::Has(ecs::Entity entity, const std::string &name) {
+    auto &ops = ecs_.component(name);
+    auto it = world_.componentMap_.find(ops.id);
+    return it != world_.componentMap_.end() &&
+           it->second.sparseSet.Contain(entity);
+}
+
+inline bool ResourcesWrapper::Has(const std::string &name) {
+    return ecs_.resource(name).has(res_);
+}
+
+inline sol::object ResourcesWrapper::Get(const std::string &name,
+                                         sol::this_state s) {
+    auto &ops = ecs_.resource(name);
+    return ops.has(res_) ? ops.get(s, res_) : sol::make_object(s, sol::lua_nil);
+}
+
+inline bool EventsWrapper::Has(const std::string &name) {
+    return ecs_.event(name).has(events_);
+}
+
+inline sol::object EventsWrapper::Read(const std::string &name,
+                                       sol::this_state s) {
+    return ecs_.event(name).read(s, events_);
+}
+
+inline void EventsWrapper::Write(const std::string &name, sol::object event) {
+    ecs_.event(name).write(events_, event);
+}
+
+}  // namespace lua_bind
@@ -1,82 +1,981 @@
 #pragma once
 
+#include <algorithm>
 #include <type_traits>
 #include <vector>
 #include <memory>
 #include <array>
+#include <atomic>
 #include <cassert>
+#include <cstdint>
+#include <iterator>
 #include <limits>
+#include <mutex>
+#include <utility>
 
-template <typename T, size_t PageSize, typename = std::enable_if<std::is_integral_v<T>>>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+//! @brief index storage of SparseSets, allocates pages on demand and releases
+//! empty pages
+//! @note fit for large or sparse key universes
+template <typename T, size_t PageSize>
+class PagedIndex final {
+public:
+    bool Contain(T t) const {
+        auto p = page(t);
+        return p < sparse_.size() && sparse_[p] &&
+               sparse_[p]->indices[offset(t)] != null;
+    }
+
+    //! @brief get index of a contained key
+    T Get(T t) const { return sparse_[page(t)]->indices[offset(t)]; }
+
+    //! @brief change index of a contained key
+    void Set(T t, T idx) { sparse_[page(t)]->indices[offset(t)] = idx; }
+
+    //! @brief add a new key
+    void Insert(T t, T idx) {
+        auto& page = assure(t);
+        page.count++;
+        page.indices[offset(t)] = idx;
+    }
+
+    //! @brief remove a contained key, release its page when empty
+    void Erase(T t) {
+        auto& pagePtr = sparse_[page(t)];
+        pagePtr->indices[offset(t)] = null;
+        if (--pagePtr->count == 0) {
+            pagePtr.reset();
+            pageCount_--;
+        }
+    }
+
+    void Reserve(T maxKey) { sparse_.reserve(page(maxKey) + 1); }
+
+    void Clear() {
+        sparse_.clear();
+        pageCount_ = 0;
+    }
+
+    void ShrinkToFit() {
+        while (!sparse_.empty() && !sparse_.back()) {
+            sparse_.pop_back();
+        }
+        sparse_.shrink_to_fit();
+    }
+
+    size_t MemoryUsage() const {
+        return sparse_.capacity() * sizeof(typename decltype(sparse_)::value_type) +
+               pageCount_ * sizeof(Page);
+    }
+
+    size_t PageCount() const { return pageCount_; }
+
+private:
+    static constexpr T null = std::numeric_limits<T>::max();
+
+    struct Page {
+        std::array<T, PageSize> indices;
+        size_t count = 0;  //!< count of elements in this page
+    };
+
+    std::vector<std::unique_ptr<Page>> sparse_;  //!< nullptr means empty page
+    size_t pageCount_ = 0;
+
+    static size_t page(T t) { return t / PageSize; }
+
+    static size_t offset(T t) { return t % PageSize; }
+
+    //! @brief allocate the page of element if it doesn't exist
+    Page& assure(T t) {
+        auto p = page(t);
+        if (p >= sparse_.size()) {
+            sparse_.resize(p + 1);
+        }
+        auto& pagePtr = sparse_[p];
+        if (!pagePtr) {
+            pagePtr = std::make_unique<Page>();
+            pagePtr->indices.fill(null);
+            pageCount_++;
+        }
+        return *pagePtr;
+    }
+};
+
+//! @brief index storage of SparseSets, a membership bitset and a flat index
+//! array covering all keys, both grow by `PageSize` keys
+//! @note fit for small and dense key universes(eg: entity IDs under 65536),
+//! membership test is one bit test and bits can be combined word-wide
+//! @see AndBits AndNotBits
+template <typename T, size_t PageSize>
+class FlatIndex final {
+public:
+    bool Contain(T t) const {
+        size_t word = t / 64;
+        return word < bits_.size() && (bits_[word] >> (t % 64)) & 1;
+    }
+
+    T Get(T t) const { return indices_[t]; }
+
+    void Set(T t, T idx) { indices_[t] = idx; }
+
+    void Insert(T t, T idx) {
+        Reserve(t);
+        bits_[t / 64] |= uint64_t(1) << (t % 64);
+        indices_[t] = idx;
+    }
+
+    void Erase(T t) { bits_[t / 64] &= ~(uint64_t(1) << (t % 64)); }
+
+    void Reserve(T maxKey) {
+        if (static_cast<size_t>(maxKey) >= indices_.size()) {
+            size_t size = (static_cast<size_t>(maxKey) / PageSize + 1) * PageSize;
+            indices_.resize(size);
+            bits_.resize((size + 63) / 64);
+        }
+    }
+
+    void Clear() {
+        indices_.clear();
+        bits_.clear();
+    }
+
+    void ShrinkToFit() {
+        while (!bits_.empty() && bits_.back() == 0) {
+            bits_.pop_back();
+        }
+        size_t size = (bits_.size() * 64 + PageSize - 1) / PageSize * PageSize;
+        indices_.resize(std::min(size, indices_.size()));
+        bits_.resize((indices_.size() + 63) / 64);
+        indices_.shrink_to_fit();
+        bits_.shrink_to_fit();
+    }
+
+    size_t MemoryUsage() const {
+        return indices_.capacity() * sizeof(T) +
+               bits_.capacity() * sizeof(uint64_t);
+    }
+
+    size_t PageCount() const { return indices_.size() / PageSize; }
+
+    //! @brief membership bits, bit `t % 64` of word `t / 64` is key `t`
+    const std::vector<uint64_t>& Words() const { return bits_; }
+
+private:
+    std::vector<T> indices_;
+    std::vector<uint64_t> bits_;
+};
+
+//! @brief sparse set of integers
+//! @tparam PageSize count of keys in one page of index storage
+//! @tparam IndexPolicy index storage, `PagedIndex` or `FlatIndex`
+template <typename T, size_t PageSize,
+          template <typename, size_t> typename IndexPolicy = PagedIndex>
 class SparseSets final {
 public:
+    static_assert(std::is_integral_v<T>);
+
+    using value_type = T;
+    using IndexStorage = IndexPolicy<T, PageSize>;
+
     void Add(T t) {
         density_.push_back(t);
-        assure(t);
-        index(t) = density_.size() - 1;
+        index_.Insert(t, density_.size() - 1);
     }
 
     void Remove(T t) {
         if (!Contain(t)) return;
 
-        auto& idx = index(t);
-        if (idx == density_.size() - 1) {
-            idx = null;
-            density_.pop_back();
-        } else {
+        auto idx = index_.Get(t);
+        if (idx != density_.size() - 1) {
             auto last = density_.back();
-            index(last) = idx;
-            std::swap(density_[idx], density_.back());
-            idx = null;
-            density_.pop_back();
+            index_.Set(last, idx);
+            density_[idx] = last;
         }
+        density_.pop_back();
+        index_.Erase(t);
     }
 
-    bool Contain(T t) const {
-        assert(t != null);
+    //! @brief reserve memory for elements
+    //! @param n count of elements
+    //! @param maxKey the max element will be added, page table grows to it
+    void Reserve(size_t n, T maxKey) {
+        density_.reserve(n);
+        index_.Reserve(maxKey);
+    }
 
-        auto p = page(t);
-        auto o = offset(t);
+    //! @brief add elements in [first, last), elements already in set are
+    //! skipped
+    template <typename It>
+    void AddRange(It first, It last) {
+        using category = typename std::iterator_traits<It>::iterator_category;
+        if constexpr (std::is_base_of_v<std::forward_iterator_tag, category>) {
+            density_.reserve(density_.size() + std::distance(first, last));
+        }
+        for (; first != last; ++first) {
+            T t = *first;
+            if (!Contain(t)) {
+                Add(t);
+            }
+        }
+    }
+
+    //! @brief remove elements in [first, last) in one compaction pass
+    //! @note order of remaining elements is unspecified
+    template <typename It>
+    void RemoveRange(It first, It last) {
+        using category = typename std::iterator_traits<It>::iterator_category;
+        if constexpr (std::is_base_of_v<std::forward_iterator_tag, category>) {
+            // swap-and-pop is cheaper than compaction when removing a few
+            if (static_cast<size_t>(std::distance(first, last)) * 16 <
+                density_.size()) {
+                for (; first != last; ++first) {
+                    Remove(*first);
+                }
+                return;
+            }
+        }
+
+        size_t removed = 0;
+        for (; first != last; ++first) {
+            T t = *first;
+            if (Contain(t)) {
+                index_.Erase(t);
+                removed++;
+            }
+        }
+        if (removed == 0) return;
+
+        size_t pos = 0;
+        for (size_t i = 0; i < density_.size(); i++) {
+            T t = density_[i];
+            if (Contain(t)) {
+                density_[pos] = t;
+                index_.Set(t, pos++);
+            }
+        }
+        density_.resize(pos);
+    }
 
-        return p < sparse_.size() && sparse_[p]->at(o) != null;
+    bool Contain(T t) const {
+        assert(t != null);
+        return index_.Contain(t);
     }
 
     void Clear() {
         density_.clear();
-        sparse_.clear();
+        index_.Clear();
     }
 
+    size_t Size() const { return density_.size(); }
+
+    //! @brief get the position of element in dense array
+    //! @note element must be contained
+    size_t Index(T t) const {
+        assert(Contain(t));
+        return index_.Get(t);
+    }
+
+    const T* Data() const { return density_.data(); }
+
+    //! @brief sort dense array in place
+    //! @param cmp compare two elements, like `std::less<T>`
+    template <typename Compare>
+    void Sort(Compare cmp) {
+        std::sort(density_.begin(), density_.end(), cmp);
+        for (size_t i = 0; i < density_.size(); i++) {
+            index_.Set(density_[i], i);
+        }
+    }
+
+    //! @brief sort dense array as the order in other set, elements also in
+    //! `other` are moved to front, others are after them in unspecified order
+    template <typename Set>
+    void SortAs(const Set& other) {
+        size_t pos = 0;
+        for (auto t : other) {
+            if (Contain(t)) {
+                swapAt(index_.Get(t), pos++);
+            }
+        }
+    }
+
+    //! @brief bytes allocated by the dense array and index storage
+    size_t MemoryUsage() const {
+        return density_.capacity() * sizeof(T) + index_.MemoryUsage();
+    }
+
+    //! @brief count of allocated pages
+    size_t PageCount() const { return index_.PageCount(); }
+
+    //! @brief release unused index storage and dense capacity
+    //! @note empty pages of `PagedIndex` are released when their last element
+    //! is removed
+    void ShrinkToFit() {
+        index_.ShrinkToFit();
+        density_.shrink_to_fit();
+    }
+
+    const IndexStorage& Indices() const { return index_; }
+
     auto begin() { return density_.begin(); }
     auto end() { return density_.end(); }
+    auto begin() const { return density_.begin(); }
+    auto end() const { return density_.end(); }
 
 private:
     std::vector<T> density_;
-    std::vector<std::unique_ptr<std::array<T, PageSize>>> sparse_;
+    IndexStorage index_;
     static constexpr T null = std::numeric_limits<T>::max();
 
-    size_t page(T t) const {
-        return t / PageSize;
+    void swapAt(size_t i, size_t j) {
+        if (i == j) return;
+        std::swap(density_[i], density_[j]);
+        index_.Set(density_[i], i);
+        index_.Set(density_[j], j);
+    }
+};
+
+//! @brief AND membership bits of sets word by word
+//! @return bit `t % 64` of word `t / 64` is set when `t` is in all sets
+//! @see ForEachBit
+template <typename T, size_t PageSize, typename... Sets>
+std::vector<uint64_t> AndBits(const SparseSets<T, PageSize, FlatIndex>& set,
+                              const Sets&... sets) {
+    std::vector<uint64_t> words = set.Indices().Words();
+    auto andWith = [&](const auto& other) {
+        auto& otherWords = other.Indices().Words();
+        if (otherWords.size() < words.size()) {
+            words.resize(otherWords.size());
+        }
+        for (size_t i = 0; i < words.size(); i++) {
+            words[i] &= otherWords[i];
+        }
+    };
+    (andWith(sets), ...);
+    return words;
+}
+
+//! @brief AND membership bits of `set` with complement bits of `sets` word by
+//! word
+//! @return bit `t % 64` of word `t / 64` is set when `t` is in `set` but not in
+//! any of `sets`
+template <typename T, size_t PageSize, typename... Sets>
+std::vector<uint64_t> AndNotBits(const SparseSets<T, PageSize, FlatIndex>& set,
+                                 const Sets&... sets) {
+    std::vector<uint64_t> words = set.Indices().Words();
+    auto andNotWith = [&](const auto& other) {
+        auto& otherWords = other.Indices().Words();
+        size_t n = std::min(words.size(), otherWords.size());
+        for (size_t i = 0; i < n; i++) {
+            words[i] &= ~otherWords[i];
+        }
+    };
+    (andNotWith(sets), ...);
+    return words;
+}
+
+//! @brief call `f(key)` for each set bit in words
+template <typename T, typename F>
+void ForEachBit(const std::vector<uint64_t>& words, F f) {
+    for (size_t i = 0; i < words.size(); i++) {
+        uint64_t word = words[i];
+        while (word) {
+#if defined(__GNUC__) || defined(__clang__)
+            int bit = __builtin_ctzll(word);
+#elif defined(_MSC_VER) && defined(_M_X64)
+            unsigned long bit;
+            _BitScanForward64(&bit, word);
+#else
+            int bit = 0;
+            while (!((word >> bit) & 1)) {
+                bit++;
+            }
+#endif
+            f(static_cast<T>(i * 64 + bit));
+            word &= word - 1;
+        }
+    }
+}
+
+//! @brief a sparse set with values, values are packed in a dense array
+//! parallel to keys
+template <typename K, typename V, size_t PageSize,
+          template <typename, size_t> typename IndexPolicy = PagedIndex>
+class SparseMap final {
+public:
+    template <bool Const>
+    class Iterator final {
+    public:
+        using ValueRef = std::conditional_t<Const, const V&, V&>;
+        using ValuePtr = std::conditional_t<Const, const V*, V*>;
+
+        Iterator(const K* keys, ValuePtr values, size_t idx)
+            : keys_(keys), values_(values), idx_(idx) {}
+
+        std::pair<const K&, ValueRef> operator*() const {
+            return {keys_[idx_], values_[idx_]};
+        }
+
+        Iterator& operator++() {
+            idx_++;
+            return *this;
+        }
+
+        bool operator==(const Iterator& o) const { return idx_ == o.idx_; }
+        bool operator!=(const Iterator& o) const { return idx_ != o.idx_; }
+
+    private:
+        const K* keys_;
+        ValuePtr values_;
+        size_t idx_;
+    };
+
+    //! @brief add a key-value pair, value will be replaced if key exists
+    V& Add(K key, const V& value) { return Emplace(key, value); }
+
+    V& Add(K key, V&& value) { return Emplace(key, std::move(value)); }
+
+    template <typename... Args>
+    V& Emplace(K key, Args&&... args) {
+        if (keys_.Contain(key)) {
+            auto& value = values_[keys_.Index(key)];
+            value = V(std::forward<Args>(args)...);
+            return value;
+        }
+        keys_.Add(key);
+        values_.emplace_back(std::forward<Args>(args)...);
+        return values_.back();
+    }
+
+    //! @brief remove key and its value, the last value is moved to the hole
+    void Remove(K key) {
+        if (!keys_.Contain(key)) return;
+
+        auto idx = keys_.Index(key);
+        keys_.Remove(key);
+        if (idx != values_.size() - 1) {
+            values_[idx] = std::move(values_.back());
+        }
+        values_.pop_back();
+    }
+
+    bool Contain(K key) const { return keys_.Contain(key); }
+
+    V& Get(K key) { return values_[keys_.Index(key)]; }
+
+    const V& Get(K key) const { return values_[keys_.Index(key)]; }
+
+    void Clear() {
+        keys_.Clear();
+        values_.clear();
+    }
+
+    size_t Size() const { return values_.size(); }
+
+    //! @brief keys in dense array, `Keys()[i]` is the key of `Values()[i]`
+    const K* Keys() const { return keys_.Data(); }
+
+    V* Values() { return values_.data(); }
+
+    const V* Values() const { return values_.data(); }
+
+    const SparseSets<K, PageSize, IndexPolicy>& KeySet() const { return keys_; }
+
+    //! @brief sort pairs by key, values are moved along with keys
+    template <typename Compare>
+    void Sort(Compare cmp) {
+        reorder([&]() { keys_.Sort(cmp); });
+    }
+
+    //! @brief sort pairs as the order in other set
+    //! @see SparseSets::SortAs
+    template <typename Set>
+    void SortAs(const Set& other) {
+        reorder([&]() { keys_.SortAs(other); });
+    }
+
+    auto begin() { return Iterator<false>(Keys(), Values(), 0); }
+    auto end() { return Iterator<false>(Keys(), Values(), Size()); }
+    auto begin() const { return Iterator<true>(Keys(), Values(), 0); }
+    auto end() const { return Iterator<true>(Keys(), Values(), Size()); }
+
+private:
+    SparseSets<K, PageSize, IndexPolicy> keys_;
+    std::vector<V> values_;
+
+    template <typename F>
+    void reorder(F sortKeys) {
+        std::vector<K> oldKeys(keys_.begin(), keys_.end());
+        sortKeys();
+
+        // from[i] is the old position of the i-th value
+        std::vector<size_t> from(values_.size());
+        for (size_t i = 0; i < oldKeys.size(); i++) {
+            from[keys_.Index(oldKeys[i])] = i;
+        }
+        std::vector<V> values;
+        values.reserve(values_.size());
+        for (auto i : from) {
+            values.emplace_back(std::move(values_[i]));
+        }
+        values_.swap(values);
+    }
+};
+
+//! @brief iterator of lazy set views, iterate driving sets in order and skip
+//! keys not accepted by the view
+template <typename View>
+class SetViewIterator final {
+public:
+    using value_type = typename View::value_type;
+
+    SetViewIterator(const View& view, size_t set, size_t pos)
+        : view_(view), set_(set), pos_(pos) {
+        skip();
+    }
+
+    value_type operator*() const { return view_.set(set_).Data()[pos_]; }
+
+    SetViewIterator& operator++() {
+        pos_++;
+        skip();
+        return *this;
+    }
+
+    bool operator==(const SetViewIterator& o) const {
+        return set_ == o.set_ && pos_ == o.pos_;
+    }
+
+    bool operator!=(const SetViewIterator& o) const { return !(*this == o); }
+
+private:
+    const View& view_;
+    size_t set_;
+    size_t pos_;
+
+    void skip() {
+        while (set_ < view_.drivingCount()) {
+            auto& set = view_.set(set_);
+            if (pos_ >= set.Size()) {
+                set_++;
+                pos_ = 0;
+            } else if (!view_.accept(set_, set.Data()[pos_])) {
+                pos_++;
+            } else {
+                break;
+            }
+        }
+    }
+};
+
+//! @brief lazy view of keys contained in all sets
+//! @note iterate the smallest set and probe others
+template <typename Set, size_t N>
+class IntersectView final {
+public:
+    using T = typename Set::value_type;
+    using value_type = T;
+    friend class SetViewIterator<IntersectView>;
+
+    explicit IntersectView(std::array<const Set*, N> sets) : sets_(sets) {
+        auto smallest = std::min_element(
+            sets_.begin(), sets_.end(),
+            [](const Set* a, const Set* b) { return a->Size() < b->Size(); });
+        std::iter_swap(sets_.begin(), smallest);
+    }
+
+    bool Contain(T t) const {
+        return std::all_of(sets_.begin(), sets_.end(),
+                           [=](const Set* set) { return set->Contain(t); });
+    }
+
+    auto begin() const { return SetViewIterator<IntersectView>(*this, 0, 0); }
+    auto end() const { return SetViewIterator<IntersectView>(*this, 1, 0); }
+
+private:
+    std::array<const Set*, N> sets_;
+
+    size_t drivingCount() const { return 1; }
+
+    const Set& set(size_t i) const { return *sets_[i]; }
+
+    bool accept(size_t, T t) const {
+        for (size_t i = 1; i < N; i++) {
+            if (!sets_[i]->Contain(t)) return false;
+        }
+        return true;
+    }
+};
+
+//! @brief lazy view of keys contained in any set
+//! @note iterate sets in order and skip keys already in previous sets
+template <typename Set, size_t N>
+class UnionView final {
+public:
+    using T = typename Set::value_type;
+    using value_type = T;
+    friend class SetViewIterator<UnionView>;
+
+    explicit UnionView(std::array<const Set*, N> sets) : sets_(sets) {}
+
+    bool Contain(T t) const {
+        return std::any_of(sets_.begin(), sets_.end(),
+                           [=](const Set* set) { return set->Contain(t); });
+    }
+
+    auto begin() const { return SetViewIterator<UnionView>(*this, 0, 0); }
+    auto end() const { return SetViewIterator<UnionView>(*this, N, 0); }
+
+private:
+    std::array<const Set*, N> sets_;
+
+    size_t drivingCount() const { return N; }
+
+    const Set& set(size_t i) const { return *sets_[i]; }
+
+    bool accept(size_t setIdx, T t) const {
+        for (size_t i = 0; i < setIdx; i++) {
+            if (sets_[i]->Contain(t)) return false;
+        }
+        return true;
+    }
+};
+
+//! @brief lazy view of keys contained in the first set but not in others
+template <typename Set, size_t N>
+class DifferenceView final {
+public:
+    using T = typename Set::value_type;
+    using value_type = T;
+    friend class SetViewIterator<DifferenceView>;
+
+    explicit DifferenceView(std::array<const Set*, N> sets) : sets_(sets) {}
+
+    bool Contain(T t) const { return sets_[0]->Contain(t) && accept(0, t); }
+
+    auto begin() const { return SetViewIterator<DifferenceView>(*this, 0, 0); }
+    auto end() const { return SetViewIterator<DifferenceView>(*this, 1, 0); }
+
+private:
+    std::array<const Set*, N> sets_;
+
+    size_t drivingCount() const { return 1; }
+
+    const Set& set(size_t i) const { return *sets_[i]; }
+
+    bool accept(size_t, T t) const {
+        for (size_t i = 1; i < N; i++) {
+            if (sets_[i]->Contain(t)) return false;
+        }
+        return true;
+    }
+};
+
+template <typename Set, typename... Sets>
+auto Intersect(const Set& set, const Sets&... sets) {
+    return IntersectView<Set, sizeof...(Sets) + 1>({&set, &sets...});
+}
+
+template <typename Set, typename... Sets>
+auto Union(const Set& set, const Sets&... sets) {
+    return UnionView<Set, sizeof...(Sets) + 1>({&set, &sets...});
+}
+
+//! @brief keys in `set` but not in any of `sets`
+template <typename Set, typename... Sets>
+auto Difference(const Set& set, const Sets&... sets) {
+    return DifferenceView<Set, sizeof...(Sets) + 1>({&set, &sets...});
+}
+
+//! @brief check a block of keys against sets
+//! @param first, last keys, at most 64(keys after the 64th are not checked),
+//! use `ContainAllBlocks` for more keys
+//! @return bit i is set when the i-th key is contained in all sets
+template <typename It, typename Set, typename... Sets>
+uint64_t ContainAll(It first, It last, const Set& set, const Sets&... sets) {
+    assert(std::distance(first, last) <= 64);
+
+    uint64_t mask = 0;
+    for (uint64_t bit = 1; first != last && bit != 0; ++first, bit <<= 1) {
+        typename Set::value_type t = *first;
+        if (set.Contain(t) && (sets.Contain(t) && ...)) {
+            mask |= bit;
+        }
+    }
+    return mask;
+}
+
+//! @brief check any number of keys against sets, 64 keys a block
+//! @return masks of `ContainAll`, bit i % 64 of mask i / 64 is set when the
+//! i-th key is contained in all sets
+template <typename It, typename Set, typename... Sets>
+std::vector<uint64_t> ContainAllBlocks(It first, It last, const Set& set,
+                                       const Sets&... sets) {
+    std::vector<uint64_t> masks;
+    while (first != last) {
+        It blockLast = first;
+        for (int i = 0; i < 64 && blockLast != last; i++) {
+            ++blockLast;
+        }
+        masks.push_back(ContainAll(first, blockLast, set, sets...));
+        first = blockLast;
+    }
+    return masks;
+}
+
+//! @brief a sparse set for one writer and many readers
+//! @note `Contain()`, `Size()` and `Each()` take no lock and can be called
+//! from any thread while the writer calls `Add()`/`Remove()`. Memory replaced
+//! by the writer(grown page table and dense array, empty pages) is retired
+//! instead of freed, call `Reclaim()` from the writer when no reader is running
+//! (eg: after parallel queries joined at the end of a frame)
+template <typename T, size_t PageSize>
+class ConcurrentSparseSets final {
+public:
+    ConcurrentSparseSets()
+        : table_(new Table(0)), dense_(new Dense(0)), size_(0) {}
+
+    ConcurrentSparseSets(const ConcurrentSparseSets&) = delete;
+    ConcurrentSparseSets& operator=(const ConcurrentSparseSets&) = delete;
+
+    ~ConcurrentSparseSets() {
+        Reclaim();
+        auto table = table_.load(std::memory_order_relaxed);
+        for (size_t i = 0; i < table->size; i++) {
+            delete table->pages[i].load(std::memory_order_relaxed);
+        }
+        delete table;
+        delete dense_.load(std::memory_order_relaxed);
     }
 
-    T index(T t) const {
-        return sparse_[page(t)]->at(offset(t));
+    //! @brief add element, writer only
+    void Add(T t) {
+        if (Contain(t)) return;
+
+        auto size = size_.load(std::memory_order_relaxed);
+        auto dense = dense_.load(std::memory_order_relaxed);
+        if (size == dense->capacity) {
+            auto newDense = new Dense(std::max<size_t>(16, dense->capacity * 2));
+            for (size_t i = 0; i < size; i++) {
+                newDense->data[i].store(
+                    dense->data[i].load(std::memory_order_relaxed),
+                    std::memory_order_relaxed);
+            }
+            dense_.store(newDense, std::memory_order_release);
+            retiredDense_.push_back(dense);
+            dense = newDense;
+        }
+
+        dense->data[size].store(t, std::memory_order_relaxed);
+        auto& page = assure(t);
+        page.count++;
+        page.indices[offset(t)].store(static_cast<T>(size),
+                                      std::memory_order_release);
+        size_.store(size + 1, std::memory_order_release);
     }
 
-    T& index(T t) {
-        return sparse_[page(t)]->at(offset(t));
+    //! @brief remove element, writer only
+    void Remove(T t) {
+        if (!Contain(t)) return;
+
+        auto table = table_.load(std::memory_order_relaxed);
+        auto dense = dense_.load(std::memory_order_relaxed);
+        auto page = table->pages[this->page(t)].load(std::memory_order_relaxed);
+        auto& slot = page->indices[offset(t)];
+        auto idx = slot.load(std::memory_order_relaxed);
+        auto last = size_.load(std::memory_order_relaxed) - 1;
+
+        if (idx != last) {
+            T lastElem = dense->data[last].load(std::memory_order_relaxed);
+            dense->data[idx].store(lastElem, std::memory_order_release);
+            table->pages[this->page(lastElem)]
+                .load(std::memory_order_relaxed)
+                ->indices[offset(lastElem)]
+                .store(idx, std::memory_order_release);
+        }
+        slot.store(null, std::memory_order_release);
+        size_.store(last, std::memory_order_release);
+
+        if (--page->count == 0) {
+            table->pages[this->page(t)].store(nullptr, std::memory_order_release);
+            retiredPages_.push_back(page);
+        }
     }
 
-    size_t offset(T t) const {
-        return t % PageSize;
+    //! @brief check element, any thread
+    bool Contain(T t) const {
+        assert(t != null);
+
+        auto table = table_.load(std::memory_order_acquire);
+        auto p = page(t);
+        if (p >= table->size) return false;
+        auto page = table->pages[p].load(std::memory_order_acquire);
+        return page && page->indices[offset(t)].load(
+                           std::memory_order_acquire) != null;
+    }
+
+    //! @brief count of elements, any thread
+    size_t Size() const { return size_.load(std::memory_order_acquire); }
+
+    //! @brief visit elements, any thread
+    //! @note elements added/removed during visiting may be visited or not, an
+    //! element moved by concurrent `Remove()` may be missed or visited twice
+    template <typename F>
+    void Each(F f) const {
+        // load size before dense: dense array is published before size grows
+        auto size = size_.load(std::memory_order_acquire);
+        auto dense = dense_.load(std::memory_order_acquire);
+        size = std::min(size, dense->capacity);
+        for (size_t i = 0; i < size; i++) {
+            f(dense->data[i].load(std::memory_order_acquire));
+        }
+    }
+
+    //! @brief remove all elements, writer only
+    void Clear() {
+        auto table = table_.load(std::memory_order_relaxed);
+        for (size_t i = 0; i < table->size; i++) {
+            if (auto page = table->pages[i].load(std::memory_order_relaxed)) {
+                table->pages[i].store(nullptr, std::memory_order_release);
+                retiredPages_.push_back(page);
+            }
+        }
+        size_.store(0, std::memory_order_release);
     }
 
-    void assure(T t) {
+    //! @brief free retired memory, writer only and no reader is running
+    void Reclaim() {
+        for (auto page : retiredPages_) delete page;
+        for (auto table : retiredTables_) delete table;
+        for (auto dense : retiredDense_) delete dense;
+        retiredPages_.clear();
+        retiredTables_.clear();
+        retiredDense_.clear();
+    }
+
+private:
+    static constexpr T null = std::numeric_limits<T>::max();
+
+    struct Page {
+        std::array<std::atomic<T>, PageSize> indices;
+        size_t count = 0;  //!< count of elements in this page, writer only
+
+        Page() {
+            for (auto& idx : indices) {
+                idx.store(null, std::memory_order_relaxed);
+            }
+        }
+    };
+
+    struct Table {
+        size_t size;
+        std::unique_ptr<std::atomic<Page*>[]> pages;
+
+        explicit Table(size_t size)
+            : size(size), pages(new std::atomic<Page*>[size]) {
+            for (size_t i = 0; i < size; i++) {
+                pages[i].store(nullptr, std::memory_order_relaxed);
+            }
+        }
+    };
+
+    struct Dense {
+        size_t capacity;
+        std::unique_ptr<std::atomic<T>[]> data;
+
+        explicit Dense(size_t capacity)
+            : capacity(capacity), data(new std::atomic<T>[capacity]) {}
+    };
+
+    std::atomic<Table*> table_;
+    std::atomic<Dense*> dense_;
+    std::atomic<size_t> size_;
+
+    std::vector<Page*> retiredPages_;
+    std::vector<Table*> retiredTables_;
+    std::vector<Dense*> retiredDense_;
+
+    static size_t page(T t) { return t / PageSize; }
+
+    static size_t offset(T t) { return t % PageSize; }
+
+    Page& assure(T t) {
         auto p = page(t);
-        if (p >= sparse_.size()) {
-            for (size_t i = sparse_.size(); i <= p; i++) {
-                sparse_.emplace_back(std::make_unique<std::array<T, PageSize>>());
-                sparse_[i]->fill(null);
+        auto table = table_.load(std::memory_order_relaxed);
+        if (p >= table->size) {
+            auto newTable = new Table(std::max(p + 1, table->size * 2));
+            for (size_t i = 0; i < table->size; i++) {
+                newTable->pages[i].store(
+                    table->pages[i].load(std::memory_order_relaxed),
+                    std::memory_order_relaxed);
             }
+            table_.store(newTable, std::memory_order_release);
+            retiredTables_.push_back(table);
+            table = newTable;
+        }
+
+        auto page = table->pages[p].load(std::memory_order_relaxed);
+        if (!page) {
+            page = new Page;
+            table->pages[p].store(page, std::memory_order_release);
+        }
+        return *page;
+    }
+};
+
+//! @brief ConcurrentSparseSets split into shards by page, writers on different
+//! shards can run at the same time
+//! @note reading is lock-free as ConcurrentSparseSets, writing locks one shard
+template <typename T, size_t PageSize, size_t Shards = 8>
+class ShardedConcurrentSparseSets final {
+public:
+    void Add(T t) {
+        auto& shard = shards_[shardOf(t)];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.set.Add(t);
+    }
+
+    void Remove(T t) {
+        auto& shard = shards_[shardOf(t)];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.set.Remove(t);
+    }
+
+    bool Contain(T t) const { return shards_[shardOf(t)].set.Contain(t); }
+
+    size_t Size() const {
+        size_t size = 0;
+        for (auto& shard : shards_) {
+            size += shard.set.Size();
+        }
+        return size;
+    }
+
+    template <typename F>
+    void Each(F f) const {
+        for (auto& shard : shards_) {
+            shard.set.Each(f);
+        }
+    }
+
+    //! @see ConcurrentSparseSets::Reclaim
+    void Reclaim() {
+        for (auto& shard : shards_) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            shard.set.Reclaim();
         }
     }
-};
\ No newline at end of file
+
+private:
+    struct Shard {
+        std::mutex mutex;
+        ConcurrentSparseSets<T, PageSize> set;
+    };
+
+    std::array<Shard, Shards> shards_;
+
+    static size_t shardOf(T t) { return (t / PageSize) % Shards; }
+};
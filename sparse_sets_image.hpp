@@ -0,0 +1,384 @@
+//! @file sparse_sets_image.hpp
+//! @brief write SparseSets/SparseMap into a flat relocatable binary image and
+//! use the image in place(eg: memory mapped) without inserting elements
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "sparse_sets.hpp"
+
+namespace sparse_sets_image {
+
+constexpr char Magic[8] = {'G', 'M', 'Q', 'S', 'S', 'E', 'T', 0};
+constexpr uint32_t Version = 1;
+constexpr size_t Alignment = 64;
+
+//! @brief image layout, all offsets are relative to the image begin
+struct Header final {
+    char magic[8];
+    uint32_t version;
+    uint32_t keySize;
+    uint64_t pageSize;
+    uint64_t count;        //!< count of elements
+    uint64_t pageCount;    //!< count of page table entries
+    uint64_t valueSize;    //!< 0 if image has no values
+    uint64_t denseOffset;  //!< keys in dense order
+    uint64_t tableOffset;  //!< page table, page offset or 0 for empty page
+    uint64_t valueOffset;  //!< values parallel to dense keys
+    uint64_t size;         //!< bytes of the whole image
+};
+
+inline uint64_t AlignUp(uint64_t offset) {
+    return (offset + Alignment - 1) / Alignment * Alignment;
+}
+
+//! @brief whether `count` elements of `elemSize` bytes from `offset` are inside
+//! `size` bytes, without overflow
+inline bool InRange(uint64_t offset, uint64_t count, uint64_t elemSize,
+                    uint64_t size) {
+    return offset <= size &&
+           (elemSize == 0 || count <= (size - offset) / elemSize);
+}
+
+//! @brief build image bytes from dense keys and values
+//! @param values values parallel to keys, nullptr if no values
+template <typename T, size_t PageSize>
+std::vector<char> BuildImage(const T* keys, size_t count, const void* values,
+                             size_t valueSize) {
+    constexpr T null = std::numeric_limits<T>::max();
+
+    uint64_t pageCount = 0;
+    for (size_t i = 0; i < count; i++) {
+        pageCount = std::max<uint64_t>(pageCount, keys[i] / PageSize + 1);
+    }
+
+    // only non-empty pages are stored, in page order
+    std::vector<uint64_t> table(pageCount, 0);
+    for (size_t i = 0; i < count; i++) {
+        table[keys[i] / PageSize] = 1;
+    }
+
+    Header header{};
+    std::memcpy(header.magic, Magic, sizeof(Magic));
+    header.version = Version;
+    header.keySize = sizeof(T);
+    header.pageSize = PageSize;
+    header.count = count;
+    header.pageCount = pageCount;
+    header.valueSize = values ? valueSize : 0;
+    header.denseOffset = AlignUp(sizeof(Header));
+    header.tableOffset = AlignUp(header.denseOffset + count * sizeof(T));
+    uint64_t offset = AlignUp(header.tableOffset + pageCount * sizeof(uint64_t));
+    for (auto& page : table) {
+        if (page) {
+            page = offset;
+            offset += PageSize * sizeof(T);
+        }
+    }
+    header.valueOffset = AlignUp(offset);
+    header.size = header.valueOffset + count * header.valueSize;
+
+    std::vector<char> image(header.size, 0);
+    std::memcpy(image.data(), &header, sizeof(header));
+    std::memcpy(image.data() + header.denseOffset, keys, count * sizeof(T));
+    std::memcpy(image.data() + header.tableOffset, table.data(),
+                pageCount * sizeof(uint64_t));
+    for (auto page : table) {
+        if (page) {
+            auto indices = reinterpret_cast<T*>(image.data() + page);
+            std::fill(indices, indices + PageSize, null);
+        }
+    }
+    for (size_t i = 0; i < count; i++) {
+        auto indices = reinterpret_cast<T*>(image.data() + table[keys[i] / PageSize]);
+        indices[keys[i] % PageSize] = static_cast<T>(i);
+    }
+    if (values) {
+        std::memcpy(image.data() + header.valueOffset, values,
+                    count * header.valueSize);
+    }
+    return image;
+}
+
+//! @brief write set into image
+template <typename T, size_t PageSize, template <typename, size_t> typename Policy>
+void WriteImage(std::ostream& o, const SparseSets<T, PageSize, Policy>& set) {
+    auto image = BuildImage<T, PageSize>(set.Data(), set.Size(), nullptr, 0);
+    o.write(image.data(), image.size());
+}
+
+//! @brief write map into image, values must be trivially copyable
+template <typename K, typename V, size_t PageSize,
+          template <typename, size_t> typename Policy>
+void WriteImage(std::ostream& o, const SparseMap<K, V, PageSize, Policy>& map) {
+    static_assert(std::is_trivially_copyable_v<V>,
+                  "values in image must be trivially copyable");
+    auto image = BuildImage<K, PageSize>(map.Keys(), map.Size(), map.Values(),
+                                         sizeof(V));
+    o.write(image.data(), image.size());
+}
+
+//! @brief use an image in place, no element is inserted
+//! @tparam V value type, void if image has no values
+//! @note the memory must outlive the view
+template <typename T, size_t PageSize, typename V = void>
+class ImageView final {
+public:
+    //! @brief view image in memory, return std::nullopt if image is invalid or
+    //! doesn't match template arguments
+    //! @note the image may come from an untrusted file, every offset and index
+    //! is validated once here(linear in image size), so a truncated or
+    //! corrupted image is rejected instead of read out of bounds
+    static std::optional<ImageView> FromMemory(const void* data, size_t size) {
+        return create(const_cast<char*>(static_cast<const char*>(data)), size,
+                      false);
+    }
+
+    //! @brief view image in writable memory(eg: copy-on-write mapping),
+    //! values can be modified
+    static std::optional<ImageView> FromWritableMemory(void* data, size_t size) {
+        return create(static_cast<char*>(data), size, true);
+    }
+
+    bool Contain(T t) const {
+        auto p = t / PageSize;
+        if (p >= header_->pageCount) return false;
+        auto page = table()[p];
+        return page && indices(page)[t % PageSize] != null;
+    }
+
+    //! @brief position of element in dense array, element must be contained
+    size_t Index(T t) const {
+        assert(Contain(t));
+        return indices(table()[t / PageSize])[t % PageSize];
+    }
+
+    size_t Size() const { return header_->count; }
+
+    const T* Data() const {
+        return reinterpret_cast<const T*>(base_ + header_->denseOffset);
+    }
+
+    template <typename U = V>
+    const std::enable_if_t<!std::is_void_v<U>, U>* Values() const {
+        return reinterpret_cast<const U*>(base_ + header_->valueOffset);
+    }
+
+    template <typename U = V>
+    std::enable_if_t<!std::is_void_v<U>, U>* MutableValues() {
+        assert(writable_ && "image memory is read-only");
+        return reinterpret_cast<U*>(base_ + header_->valueOffset);
+    }
+
+    template <typename U = V>
+    const std::enable_if_t<!std::is_void_v<U>, U>& Get(T t) const {
+        return Values()[Index(t)];
+    }
+
+    auto begin() const { return Data(); }
+    auto end() const { return Data() + Size(); }
+
+private:
+    static constexpr T null = std::numeric_limits<T>::max();
+
+    char* base_;
+    const Header* header_;
+    bool writable_;
+
+    ImageView(char* base, bool writable)
+        : base_(base),
+          header_(reinterpret_cast<const Header*>(base)),
+          writable_(writable) {}
+
+    static std::optional<ImageView> create(char* base, size_t size,
+                                           bool writable) {
+        if (size < sizeof(Header)) return std::nullopt;
+        auto header = reinterpret_cast<const Header*>(base);
+        size_t valueSize = 0, valueAlignment = 1;
+        if constexpr (!std::is_void_v<V>) {
+            valueSize = sizeof(V);
+            valueAlignment = alignof(V);
+        }
+        if (std::memcmp(header->magic, Magic, sizeof(Magic)) != 0 ||
+            header->version != Version || header->keySize != sizeof(T) ||
+            header->pageSize != PageSize || header->valueSize != valueSize ||
+            header->size > size || header->size < sizeof(Header)) {
+            return std::nullopt;
+        }
+        if (!InRange(header->denseOffset, header->count, sizeof(T),
+                     header->size) ||
+            !InRange(header->tableOffset, header->pageCount, sizeof(uint64_t),
+                     header->size) ||
+            !InRange(header->valueOffset, header->count, valueSize,
+                     header->size) ||
+            header->denseOffset % alignof(T) != 0 ||
+            header->tableOffset % alignof(uint64_t) != 0 ||
+            header->valueOffset % valueAlignment != 0 ||
+            !validatePages(base, *header)) {
+            return std::nullopt;
+        }
+        return ImageView(base, writable);
+    }
+
+    //! @brief pages must be inside image, indices in pages must be in dense
+    //! array and every dense key must be indexed at its own position
+    static bool validatePages(const char* base, const Header& header) {
+        auto table =
+            reinterpret_cast<const uint64_t*>(base + header.tableOffset);
+        for (uint64_t p = 0; p < header.pageCount; p++) {
+            if (table[p] == 0) {
+                continue;
+            }
+            if (table[p] % alignof(T) != 0 ||
+                !InRange(table[p], PageSize, sizeof(T), header.size)) {
+                return false;
+            }
+            auto page = reinterpret_cast<const T*>(base + table[p]);
+            for (size_t i = 0; i < PageSize; i++) {
+                if (page[i] != null && page[i] >= header.count) {
+                    return false;
+                }
+            }
+        }
+
+        auto dense = reinterpret_cast<const T*>(base + header.denseOffset);
+        for (uint64_t i = 0; i < header.count; i++) {
+            uint64_t p = dense[i] / PageSize;
+            if (p >= header.pageCount || table[p] == 0) {
+                return false;
+            }
+            auto page = reinterpret_cast<const T*>(base + table[p]);
+            if (page[dense[i] % PageSize] != i) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    const uint64_t* table() const {
+        return reinterpret_cast<const uint64_t*>(base_ + header_->tableOffset);
+    }
+
+    const T* indices(uint64_t page) const {
+        return reinterpret_cast<const T*>(base_ + page);
+    }
+};
+
+//! @brief a memory mapped image file
+class MappedFile final {
+public:
+    enum class Mode {
+        ReadOnly,
+        CopyOnWrite,  //!< writable, changes are private and never saved
+    };
+
+    MappedFile() = default;
+
+    MappedFile(const std::string& filename, Mode mode) { Open(filename, mode); }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    MappedFile(MappedFile&& o) noexcept { *this = std::move(o); }
+
+    MappedFile& operator=(MappedFile&& o) noexcept {
+        if (this != &o) {
+            Close();
+            std::swap(data_, o.data_);
+            std::swap(size_, o.size_);
+        }
+        return *this;
+    }
+
+    ~MappedFile() { Close(); }
+
+    bool Open(const std::string& filename, Mode mode) {
+        Close();
+#ifdef _WIN32
+        HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ,
+                                  FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                  FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) return false;
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+            CloseHandle(file);
+            return false;
+        }
+        HANDLE mapping = CreateFileMappingA(
+            file, nullptr,
+            mode == Mode::ReadOnly ? PAGE_READONLY : PAGE_WRITECOPY, 0, 0,
+            nullptr);
+        CloseHandle(file);
+        if (!mapping) return false;
+        data_ = MapViewOfFile(
+            mapping, mode == Mode::ReadOnly ? FILE_MAP_READ : FILE_MAP_COPY, 0,
+            0, 0);
+        CloseHandle(mapping);
+        if (!data_) return false;
+        size_ = static_cast<size_t>(size.QuadPart);
+#else
+        int fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0) {
+            close(fd);
+            return false;
+        }
+        int prot = PROT_READ | (mode == Mode::ReadOnly ? 0 : PROT_WRITE);
+        void* data = mmap(nullptr, st.st_size, prot, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (data == MAP_FAILED) return false;
+        data_ = data;
+        size_ = static_cast<size_t>(st.st_size);
+#endif
+        return true;
+    }
+
+    void Close() {
+        if (!data_) return;
+#ifdef _WIN32
+        UnmapViewOfFile(data_);
+#else
+        munmap(data_, size_);
+#endif
+        data_ = nullptr;
+        size_ = 0;
+    }
+
+    bool Valid() const { return data_ != nullptr; }
+
+    const void* Data() const { return data_; }
+
+    //! @brief writable memory, only valid in `Mode::CopyOnWrite`
+    void* MutableData() { return data_; }
+
+    size_t Size() const { return size_; }
+
+private:
+    void* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+}  // namespace sparse_sets_image